@@ -0,0 +1,254 @@
+#include "swiss.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const size_t RESIZING_WORK = 128; // constant work
+static const size_t MIN_SLOTS = 2 * SGROUP_SIZE;
+
+// control bytes, a full slot holds 0x80 | its 7 bit tag instead. Empty is 0
+// so a fresh table comes from calloc without touching its pages.
+enum { EMPTY = 0, DELETED = 1 };
+
+void initSTable(STable *table) {
+  table->ctrl = NULL;
+  table->slots = NULL;
+  table->mask = 0;
+  table->size = 0;
+  table->deleted = 0;
+}
+
+void initSMap(SMap *map) {
+  initSTable(&map->table1);
+  initSTable(&map->table2);
+  map->resizingPosition = 0;
+}
+
+static void initialize(STable *table, size_t n) {
+  assert(n >= SGROUP_SIZE && ((n - 1) & n) == 0); // must be a power of 2
+  table->ctrl = (int8_t *)calloc(n, 1);
+  table->slots = (CNode **)malloc(n * sizeof(CNode *));
+  table->mask = n - 1;
+  table->size = 0;
+  table->deleted = 0;
+}
+
+static void release(STable *table) {
+  free(table->ctrl);
+  free(table->slots);
+  initSTable(table);
+}
+
+static int8_t tag(uint64_t code) { return (int8_t)(0x80 | (code & 0x7F)); }
+
+// keep 1/8 of the slots empty, so every probe ends
+static size_t maxLoad(const STable *table) {
+  return (table->mask + 1) / 8 * 7;
+}
+
+// bit i is set if control byte i of the group equals `byte`
+static uint32_t match(const int8_t *group, int8_t byte) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  __m128i bytes = _mm_set1_epi8(byte);
+  return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, bytes));
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < SGROUP_SIZE; ++i) {
+    mask |= (uint32_t)(group[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+// bit i is set if slot i of the group is full
+static uint32_t matchFull(const int8_t *group) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return (uint32_t)_mm_movemask_epi8(ctrl); // the high bits
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < SGROUP_SIZE; ++i) {
+    mask |= (uint32_t)(group[i] < 0) << i;
+  }
+  return mask;
+#endif
+}
+
+// bit i is set if slot i of the group is empty or deleted
+static uint32_t matchFree(const int8_t *group) {
+  return ~matchFull(group) & ((1u << SGROUP_SIZE) - 1);
+}
+
+/*
+ * Groups are probed in triangular steps from the one the hash picks, which
+ * visits every group of a power of 2 table.
+ */
+static size_t firstGroup(const STable *table, uint64_t code) {
+  return (code >> 7) & (table->mask / SGROUP_SIZE);
+}
+
+static size_t nextGroup(const STable *table, size_t group, size_t step) {
+  return (group + step) & (table->mask / SGROUP_SIZE);
+}
+
+static void insert(STable *table, CNode *node) {
+  size_t group = firstGroup(table, node->code);
+  for (size_t step = 1;; ++step) {
+    uint32_t free = matchFree(table->ctrl + group * SGROUP_SIZE);
+    if (free) {
+      size_t index = group * SGROUP_SIZE + (size_t)__builtin_ctz(free);
+      table->deleted -= table->ctrl[index] == DELETED;
+      table->ctrl[index] = tag(node->code);
+      table->slots[index] = node;
+      table->size++;
+      return;
+    }
+    group = nextGroup(table, group, step);
+  }
+}
+
+static CNode **lookUp(STable *table, CNode *key, bool (*eq)(CNode *, CNode *)) {
+  if (!table->slots) {
+    return NULL;
+  }
+
+  int8_t h2 = tag(key->code);
+  size_t group = firstGroup(table, key->code);
+  for (size_t step = 1;; ++step) {
+    const int8_t *ctrl = table->ctrl + group * SGROUP_SIZE;
+    for (uint32_t m = match(ctrl, h2); m; m &= m - 1) {
+      CNode **from =
+          &table->slots[group * SGROUP_SIZE + (size_t)__builtin_ctz(m)];
+      if ((*from)->code == key->code && eq(*from, key)) {
+        return from;
+      }
+    }
+    if (match(ctrl, EMPTY)) {
+      return NULL; // the probe never went past this group
+    }
+    group = nextGroup(table, group, step);
+  }
+}
+
+static CNode *detach(STable *table, CNode **from) {
+  size_t index = (size_t)(from - table->slots);
+  const int8_t *group = table->ctrl + (index & ~(size_t)(SGROUP_SIZE - 1));
+  if (match(group, EMPTY)) {
+    table->ctrl[index] = EMPTY; // no probe goes past this group
+  } else {
+    table->ctrl[index] = DELETED; // keep the probes going
+    table->deleted++;
+  }
+  table->size--;
+  return *from;
+}
+
+static void helpResizing(SMap *map) {
+  STable *from = &map->table2;
+  size_t work = 0;
+  while (work < RESIZING_WORK && from->size > 0) {
+    // move the nodes of one group of the second table to the first
+    size_t position = map->resizingPosition;
+    uint32_t full = matchFull(from->ctrl + position);
+    for (; full; full &= full - 1) {
+      size_t index = position + (size_t)__builtin_ctz(full);
+      insert(&map->table1, detach(from, &from->slots[index]));
+      work++;
+    }
+    map->resizingPosition += SGROUP_SIZE;
+    work++;
+  }
+
+  if (from->size == 0 && from->slots) {
+    release(from);
+  }
+}
+
+// the table for `size` nodes, at most half full, with room for the inserts
+// that come while RESIZING_WORK at a time moves `from` over
+static size_t capacityFor(size_t size, const STable *from) {
+  size_t work = from->size + (from->mask + 1) / SGROUP_SIZE;
+  size_t n = MIN_SLOTS;
+  while (n / 2 < size ||
+         (n / 8 * 7 - size) * RESIZING_WORK < work + RESIZING_WORK) {
+    n *= 2;
+  }
+  return n;
+}
+
+/*
+ * Moves the nodes to a table sized for them. That grows a full table, drops
+ * the tombstones of a table that is full of them, and shrinks a sparse one.
+ * The new table has room for the inserts until the old one is empty, so no
+ * insert has to finish a resize.
+ */
+static void startResizing(SMap *map) {
+  assert(map->table2.slots == NULL);
+  map->table2 = map->table1;
+  initialize(&map->table1, capacityFor(map->table2.size, &map->table2));
+  map->resizingPosition = 0;
+}
+
+static void shrinkIfSparse(SMap *map) {
+  size_t n = map->table1.mask + 1;
+  if (!map->table2.slots && n > MIN_SLOTS && map->table1.size < n / 8) {
+    startResizing(map);
+  }
+}
+
+CNode *SMapLookUp(SMap *map, CNode *key, bool (*eq)(CNode *, CNode *)) {
+  helpResizing(map);
+  CNode **from = lookUp(&map->table1, key, eq);
+  from = from ? from : lookUp(&map->table2, key, eq);
+  return from ? *from : NULL;
+}
+
+void SMapInsert(SMap *map, CNode *node) {
+  if (!map->table1.slots) {
+    initialize(&map->table1, MIN_SLOTS);
+  }
+
+  insert(&map->table1, node);
+
+  // a resize in progress always ends before its table fills up
+  if (!map->table2.slots &&
+      map->table1.size + map->table1.deleted >= maxLoad(&map->table1)) {
+    startResizing(map);
+  }
+  helpResizing(map);
+}
+
+CNode *SMapPop(SMap *map, CNode *key, bool (*eq)(CNode *, CNode *)) {
+  helpResizing(map);
+  CNode **from = lookUp(&map->table1, key, eq);
+  CNode *node = NULL;
+  if (from) {
+    node = detach(&map->table1, from);
+  } else if ((from = lookUp(&map->table2, key, eq)) != NULL) {
+    node = detach(&map->table2, from);
+  }
+
+  if (node) {
+    shrinkIfSparse(map);
+  }
+  return node;
+}
+
+bool SMapRehash(SMap *map) {
+  helpResizing(map);
+  shrinkIfSparse(map); // pops that came during a resize could not start it
+  return map->table2.slots != NULL;
+}
+
+size_t SMapSize(const SMap *map) { return map->table1.size + map->table2.size; }
+
+void SMapDestroy(SMap *map) {
+  release(&map->table1);
+  release(&map->table2);
+  initSMap(map);
+}
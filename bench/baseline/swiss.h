@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An open addressing map of intrusive CNodes, `next` is unused.
+ *
+ * Slots are split into groups of SGROUP_SIZE. Every slot has a control byte
+ * that is either empty, deleted, or the tag of the node in the slot: the low 7
+ * bits of its hash with the high bit set. A probe loads the control bytes of a
+ * whole group at once and compares them against the tag in one go, so only
+ * the slots whose tag matches are looked at.
+ */
+#define SGROUP_SIZE 16
+
+typedef struct STable {
+  int8_t *ctrl;   // one control byte per slot
+  CNode **slots;  // the nodes
+  size_t mask;    // number of slots - 1
+  size_t size;    // full slots
+  size_t deleted; // tombstones
+} STable;
+
+typedef struct SMap {
+  STable table1; // receives the inserts
+  STable table2; // being moved into table1 while resizing
+  size_t resizingPosition;
+} SMap;
+
+static inline bool STableFull(const STable *table, size_t index) {
+  return table->ctrl[index] < 0; // the high bit
+}
+
+void initSTable(STable *table);
+void initSMap(SMap *map);
+
+CNode *SMapLookUp(SMap *map, CNode *key, bool (*eq)(CNode *, CNode *));
+void SMapInsert(SMap *map, CNode *node);
+CNode *SMapPop(SMap *map, CNode *key, bool (*eq)(CNode *, CNode *));
+size_t SMapSize(const SMap *map);
+/*
+ * Does one step of a pending resize, meant for when the map is otherwise
+ * idle. Returns true while there is more to do.
+ */
+bool SMapRehash(SMap *map);
+void SMapDestroy(SMap *map);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "swiss.h"
+
+constexpr std::size_t MANY_KEYS = 100000;
+
+struct Item {
+  CNode node; // first, so a node is its item
+  std::uint64_t key;
+};
+
+auto equalityItem = [](CNode *lhs, CNode *rhs) {
+  return reinterpret_cast<Item *>(lhs)->key ==
+         reinterpret_cast<Item *>(rhs)->key;
+};
+
+class SwissTest : public ::testing::Test {
+protected:
+  void SetUp() override { initSMap(&sMap); }
+  void TearDown() override { SMapDestroy(&sMap); }
+
+  auto lookUp(std::uint64_t code, std::uint64_t key) -> Item * {
+    Item item = {.node = {.code = code}, .key = key};
+    return reinterpret_cast<Item *>(
+        SMapLookUp(&sMap, &item.node, equalityItem));
+  }
+
+  auto pop(std::uint64_t code, std::uint64_t key) -> Item * {
+    Item item = {.node = {.code = code}, .key = key};
+    return reinterpret_cast<Item *>(SMapPop(&sMap, &item.node, equalityItem));
+  }
+
+  SMap sMap;
+};
+
+TEST_F(SwissTest, SMapInsertLookUpAndPopTest) {
+  Item item1 = {.node = {.code = 1}, .key = 1};
+  Item item2 = {.node = {.code = 2}, .key = 2};
+
+  SMapInsert(&sMap, &item1.node);
+  SMapInsert(&sMap, &item2.node);
+  ASSERT_EQ(SMapSize(&sMap), 2);
+
+  ASSERT_EQ(lookUp(1, 1), &item1);
+  ASSERT_EQ(lookUp(2, 2), &item2);
+  ASSERT_EQ(lookUp(3, 3), nullptr);
+
+  ASSERT_EQ(pop(1, 1), &item1);
+  ASSERT_EQ(pop(1, 1), nullptr);
+  ASSERT_EQ(lookUp(1, 1), nullptr);
+  ASSERT_EQ(lookUp(2, 2), &item2);
+  ASSERT_EQ(SMapSize(&sMap), 1);
+}
+
+TEST_F(SwissTest, SMapEqualHashesTest) {
+  // same hash, the nodes are told apart by the equality function only
+  std::vector<Item> items(3 * SGROUP_SIZE);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i] = {.node = {.code = 42}, .key = i};
+    SMapInsert(&sMap, &items[i].node);
+  }
+
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    ASSERT_EQ(lookUp(42, i), &items[i]);
+  }
+  ASSERT_EQ(lookUp(42, items.size()), nullptr);
+}
+
+TEST_F(SwissTest, SMapResizesIncrementallyTest) {
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    // low 7 bits are the tag, make every node share one
+    items[i] = {.node = {.code = i << 7}, .key = i};
+    SMapInsert(&sMap, &items[i].node);
+
+    // a resize moves only a few nodes at a time, the rest stay reachable
+    ASSERT_EQ(lookUp(i / 2 << 7, i / 2), &items[i / 2]);
+  }
+  ASSERT_EQ(SMapSize(&sMap), items.size());
+
+  for (std::size_t i = 0; i < items.size(); i += 2) {
+    ASSERT_EQ(pop(i << 7, i), &items[i]);
+  }
+  ASSERT_EQ(SMapSize(&sMap), items.size() / 2);
+
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    ASSERT_EQ(lookUp(i << 7, i), i % 2 ? &items[i] : nullptr);
+  }
+}
+
+TEST_F(SwissTest, SMapReusesTombstonesTest) {
+  // a small live set under heavy churn does not grow the table
+  std::vector<Item> items(8);
+  for (std::size_t round = 0; round < MANY_KEYS; ++round) {
+    auto &item = items[round % items.size()];
+    if (round >= items.size()) {
+      ASSERT_EQ(pop(item.node.code, item.key), &item);
+    }
+    item = {.node = {.code = round * 0x9E3779B97F4A7C15}, .key = round};
+    SMapInsert(&sMap, &item.node);
+  }
+
+  ASSERT_EQ(SMapSize(&sMap), items.size());
+  ASSERT_LE(sMap.table1.mask + 1, 4 * SGROUP_SIZE);
+  for (const auto &item : items) {
+    ASSERT_EQ(lookUp(item.node.code, item.key), &item);
+  }
+}
+
+TEST_F(SwissTest, SMapShrinksWhenSparseTest) {
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i] = {.node = {.code = i * 0x9E3779B97F4A7C15}, .key = i};
+    SMapInsert(&sMap, &items[i].node);
+  }
+  auto peak = sMap.table1.mask + 1;
+
+  for (std::size_t i = SGROUP_SIZE; i < items.size(); ++i) {
+    ASSERT_EQ(pop(items[i].node.code, i), &items[i]);
+  }
+  while (SMapRehash(&sMap)) {
+  }
+
+  ASSERT_EQ(SMapSize(&sMap), SGROUP_SIZE);
+  ASSERT_EQ(sMap.table2.slots, nullptr);
+  ASSERT_LE(sMap.table1.mask + 1, 8 * SMapSize(&sMap)); // at least 1/8 full
+  ASSERT_LT(sMap.table1.mask + 1, peak);
+  for (std::size_t i = 0; i < SGROUP_SIZE; ++i) {
+    ASSERT_EQ(lookUp(items[i].node.code, i), &items[i]);
+  }
+}
+
+TEST_F(SwissTest, SMapRehashFinishesAResizeTest) {
+  std::vector<Item> items(MANY_KEYS);
+  std::size_t i = 0;
+  for (; i < items.size() && !sMap.table2.slots; ++i) {
+    items[i] = {.node = {.code = i * 0x9E3779B97F4A7C15}, .key = i};
+    SMapInsert(&sMap, &items[i].node);
+  }
+  ASSERT_NE(sMap.table2.slots, nullptr);
+
+  // no other operation comes, the idle steps move every node
+  while (SMapRehash(&sMap)) {
+  }
+  ASSERT_EQ(sMap.table2.slots, nullptr);
+  ASSERT_EQ(SMapSize(&sMap), i);
+  ASSERT_FALSE(SMapRehash(&sMap));
+}
+
+TEST_F(SwissTest, SMapInsertDoesOneResizeStepTest) {
+  constexpr std::size_t STEP_SLOTS = 128 * SGROUP_SIZE; // RESIZING_WORK groups
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i] = {.node = {.code = i * 0x9E3779B97F4A7C15}, .key = i};
+  }
+  auto insertStep = [&](Item &item) {
+    const auto *resizing = sMap.table2.ctrl;
+    auto position = sMap.resizingPosition;
+    SMapInsert(&sMap, &item.node);
+    if (resizing) {
+      // the same resize goes on, or it ended, but no other one started
+      ASSERT_TRUE(sMap.table2.ctrl == resizing || !sMap.table2.ctrl);
+      if (sMap.table2.ctrl) {
+        ASSERT_LE(sMap.resizingPosition - position, STEP_SLOTS);
+      }
+    }
+  };
+
+  // grows, shrinks down to a few nodes, and grows again
+  for (auto &item : items) {
+    insertStep(item);
+  }
+  for (std::size_t i = SGROUP_SIZE; i < items.size(); ++i) {
+    ASSERT_EQ(pop(items[i].node.code, i), &items[i]);
+  }
+  for (std::size_t i = SGROUP_SIZE; i < items.size(); ++i) {
+    insertStep(items[i]);
+  }
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    ASSERT_EQ(lookUp(items[i].node.code, i), &items[i]);
+  }
+}
@@ -0,0 +1,37 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "hash/hash.hxx"
+
+/**
+ * @brief The hash the maps used before, one byte at a time and only 32 bits.
+ */
+static auto fnvHash(std::string_view data) -> std::uint64_t {
+  std::uint32_t hash = 0x811C9DC5;
+  for (const auto &letter : data) {
+    hash = (hash + letter) * 0x01000193;
+  }
+  return hash;
+}
+
+static void BM_Fnv(benchmark::State &state) {
+  std::string key(static_cast<std::size_t>(state.range(0)), 'k');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(key.data());
+    benchmark::DoNotOptimize(fnvHash(key));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_StringHash(benchmark::State &state) {
+  std::string key(static_cast<std::size_t>(state.range(0)), 'k');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(key.data());
+    benchmark::DoNotOptimize(stringHash(key));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_Fnv)->RangeMultiplier(2)->Range(8, 256);
+BENCHMARK(BM_StringHash)->RangeMultiplier(2)->Range(8, 256);
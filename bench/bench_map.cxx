@@ -0,0 +1,195 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench/baseline/map.h"
+#include "bench/baseline/map.hxx"
+#include "bench/baseline/swiss.h"
+#include "map/cxx/intrusive.hxx"
+
+constexpr std::int64_t NUM_KEYS = 10'000'000;
+constexpr std::size_t NUM_PROBES = 1 << 20;
+
+struct Item {
+  CNode node; // first, so a node is its item
+  std::uint64_t key;
+  HashNode hashNode;
+};
+
+static auto equality(CNode *lhs, CNode *rhs) -> bool {
+  return reinterpret_cast<Item *>(lhs)->key ==
+         reinterpret_cast<Item *>(rhs)->key;
+}
+
+// splitmix64, the keyspace hashes strings but any good 64 bit hash will do
+static auto hash(std::uint64_t x) -> std::uint64_t {
+  x += 0x9E3779B97F4A7C15;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+  return x ^ (x >> 31);
+}
+
+static auto items(std::int64_t n) -> std::unique_ptr<Item[]> {
+  auto result = std::make_unique<Item[]>(static_cast<std::size_t>(n));
+  for (std::int64_t i = 0; i < n; ++i) {
+    auto key = static_cast<std::uint64_t>(i);
+    result[i] = {.node = {.next = nullptr, .code = hash(key)},
+                 .key = key,
+                 .hashNode = {}};
+  }
+  return result;
+}
+
+// random keys to look up, half of them are missing if `hits` is false
+static auto probes(std::int64_t n, bool hits) -> std::vector<Item> {
+  std::mt19937_64 random(42);
+  std::vector<Item> result(NUM_PROBES);
+  for (auto &probe : result) {
+    auto key = random() % static_cast<std::uint64_t>(hits ? n : 2 * n);
+    probe = {.node = {.next = nullptr, .code = hash(key)},
+             .key = key,
+             .hashNode = {}};
+  }
+  return result;
+}
+
+struct ItemHash {
+  auto operator()(const Item &item) const { return item.node.code; }
+  auto operator()(const Item *probe) const { return probe->node.code; }
+};
+
+struct ItemEq {
+  auto operator()(const Item &item, const Item *probe) const {
+    return item.key == probe->key;
+  }
+};
+
+using ItemMap = IntrusiveHashMap<Item, &Item::hashNode, ItemHash, ItemEq>;
+
+/**
+ * @brief The operations of one map type, so all of them run the same
+ * benchmarks.
+ */
+struct Chained {
+  using Type = CMap;
+  static void init(CMap *map) { initMap(map); }
+  static void insert(CMap *map, Item *item) { CMapInsert(map, &item->node); }
+  static auto lookup(CMap *map, Item *probe) {
+    return CMapLookUp(map, &probe->node, &equality);
+  }
+  static void destroy(CMap *map) { CMapDestroy(map); }
+};
+
+struct Swiss {
+  using Type = SMap;
+  static void init(SMap *map) { initSMap(map); }
+  static void insert(SMap *map, Item *item) { SMapInsert(map, &item->node); }
+  static auto lookup(SMap *map, Item *probe) {
+    return SMapLookUp(map, &probe->node, &equality);
+  }
+  static void destroy(SMap *map) { SMapDestroy(map); }
+};
+
+struct Intrusive {
+  using Type = ItemMap;
+  static void init(ItemMap *) {}
+  static void insert(ItemMap *map, Item *item) { map->insert(item); }
+  static auto lookup(ItemMap *map, Item *probe) { return map->find(probe); }
+  static void destroy(ItemMap *map) { map->clear(); }
+};
+
+/**
+ * @brief Inserts every key, reporting the slowest single insert so a resize
+ * that stalls shows up.
+ */
+template <typename M> static void BM_Insert(benchmark::State &state) {
+  auto n = state.range(0);
+  std::chrono::nanoseconds slowest{0};
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto nodes = items(n);
+    typename M::Type map;
+    M::init(&map);
+    state.ResumeTiming();
+
+    for (std::int64_t i = 0; i < n; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      M::insert(&map, &nodes[i]);
+      slowest = std::max(slowest, std::chrono::steady_clock::now() - start);
+    }
+
+    state.PauseTiming();
+    M::destroy(&map);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.counters["slowest_insert_us"] =
+      static_cast<double>(slowest.count()) / 1000;
+}
+
+template <typename M> static void BM_LookUp(benchmark::State &state) {
+  auto n = state.range(0);
+  auto nodes = items(n);
+  typename M::Type map;
+  M::init(&map);
+  for (std::int64_t i = 0; i < n; ++i) {
+    M::insert(&map, &nodes[i]);
+  }
+  auto keys = probes(n, state.range(1));
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    auto &probe = keys[i++ & (NUM_PROBES - 1)];
+    benchmark::DoNotOptimize(M::lookup(&map, &probe));
+  }
+  state.SetItemsProcessed(state.iterations());
+  M::destroy(&map);
+}
+
+/**
+ * @brief Misses in the std::function map. A hit moves the node out of its
+ * chain, so it can not be repeated on the same map.
+ */
+static void BM_LookUpMissFunction(benchmark::State &state) {
+  auto n = state.range(0);
+  Map map;
+  for (std::int64_t i = 0; i < n; ++i) {
+    auto node = std::make_unique<Node>();
+    node->code = hash(static_cast<std::uint64_t>(i));
+    mapInsert(map, std::move(node));
+  }
+  auto keys = probes(n, false);
+  std::vector<Node> misses(NUM_PROBES);
+  for (std::size_t i = 0; i < NUM_PROBES; ++i) {
+    // only the keys at or above n are missing
+    misses[i].code = keys[i].key >= static_cast<std::uint64_t>(n)
+                         ? keys[i].node.code
+                         : hash(keys[i].key + static_cast<std::uint64_t>(n));
+  }
+  auto equal = [](const std::unique_ptr<Node> &lhs, const Node &rhs) {
+    return lhs->code == rhs.code;
+  };
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    auto &probe = misses[i++ & (NUM_PROBES - 1)];
+    benchmark::DoNotOptimize(mapLookUp(map, probe, equal));
+  }
+  state.SetItemsProcessed(state.iterations());
+  mapDestroy(map);
+}
+
+BENCHMARK(BM_Insert<Chained>)->Arg(NUM_KEYS)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Insert<Swiss>)->Arg(NUM_KEYS)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Insert<Intrusive>)->Arg(NUM_KEYS)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LookUp<Chained>)->Args({NUM_KEYS, true})->Args({NUM_KEYS, false});
+BENCHMARK(BM_LookUp<Swiss>)->Args({NUM_KEYS, true})->Args({NUM_KEYS, false});
+BENCHMARK(BM_LookUp<Intrusive>)
+    ->Args({NUM_KEYS, true})
+    ->Args({NUM_KEYS, false});
+BENCHMARK(BM_LookUpMissFunction)->Arg(NUM_KEYS);
@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/buffer.hxx"
+#include "common/req.hxx"
+#include "common/serialize.hxx"
+
+constexpr std::size_t NUM_KEYS = 4'000'000; // far more than the caches hold
+
+static auto keyName(std::size_t i) -> std::string {
+  return "key:" + std::to_string(i);
+}
+
+/**
+ * @brief Runs one command through the dispatcher and drops the response.
+ *
+ * @param request The dispatcher.
+ * @param buffer Where the response is written.
+ * @param commands The arguments of the command.
+ */
+static void run(Request &request, ChunkedBuffer &buffer,
+                const std::vector<std::string> &commands) {
+  Arguments args;
+  for (const auto &s : commands) {
+    args.push_back(s);
+  }
+  Output output(buffer);
+  request(args, output);
+  output.finish();
+  buffer.consume(buffer.size());
+}
+
+static void fill(Request &request, ChunkedBuffer &buffer) {
+  static bool filled = false;
+  if (filled) {
+    return;
+  }
+  for (std::size_t i = 0; i < NUM_KEYS; ++i) {
+    run(request, buffer, {"set", keyName(i), "value"});
+  }
+  filled = true;
+}
+
+// a batch of random keys, formatted up front so only the lookups are timed
+static auto batches(std::size_t batchSize)
+    -> std::vector<std::vector<std::string>> {
+  std::mt19937_64 rng(42);
+  std::vector<std::vector<std::string>> result(1024);
+  for (auto &batch : result) {
+    for (std::size_t i = 0; i < batchSize; ++i) {
+      batch.push_back(keyName(rng() % NUM_KEYS));
+    }
+  }
+  return result;
+}
+
+static void BM_PipelinedGet(benchmark::State &state) {
+  Request request;
+  ChunkedBuffer buffer(ChunkPool::shared);
+  fill(request, buffer);
+  auto keys = batches(static_cast<std::size_t>(state.range(0)));
+
+  std::size_t n = 0;
+  for (auto _ : state) {
+    for (const auto &key : keys[n++ % keys.size()]) {
+      run(request, buffer, {"get", key});
+    }
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+static void BM_MGet(benchmark::State &state) {
+  Request request;
+  ChunkedBuffer buffer(ChunkPool::shared);
+  fill(request, buffer);
+  auto keys = batches(static_cast<std::size_t>(state.range(0)));
+  for (auto &batch : keys) {
+    batch.insert(batch.begin(), "mget");
+  }
+
+  std::size_t n = 0;
+  for (auto _ : state) {
+    run(request, buffer, keys[n++ % keys.size()]);
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+BENCHMARK(BM_PipelinedGet)->Arg(16)->Arg(64);
+BENCHMARK(BM_MGet)->Arg(16)->Arg(64);
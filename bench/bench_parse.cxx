@@ -0,0 +1,102 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/req.hxx"
+
+/**
+ * @brief Frames @p commands the way a client sends them, without the length.
+ *
+ * +------+-----+------+-----+------+-----
+ * | nstr | len | str1 | len | str2 | ...
+ * +------+-----+------+-----+------+-----
+ *
+ * @param commands The arguments of the request.
+ * @return the request body.
+ */
+static auto frame(const std::vector<std::string> &commands)
+    -> std::vector<std::uint8_t> {
+  std::vector<std::uint8_t> body(4);
+  auto n = static_cast<std::uint32_t>(commands.size());
+  std::memcpy(body.data(), &n, 4);
+  for (const auto &s : commands) {
+    auto len = static_cast<std::uint32_t>(s.size());
+    auto *bytes = reinterpret_cast<std::uint8_t *>(&len);
+    body.insert(body.end(), bytes, bytes + 4);
+    body.insert(body.end(), s.begin(), s.end());
+  }
+  return body;
+}
+
+/**
+ * @brief The parser as it was before arguments became views, copying every
+ * argument into its own string.
+ */
+static auto parseOwning(std::uint8_t &requestData, std::size_t length,
+                        std::vector<std::string> &outputData)
+    -> std::uint32_t {
+  if (length < 4) {
+    return -1;
+  }
+
+  std::uint32_t count = 0;
+  std::memcpy(&count, &requestData, 4);
+  if (count > MAX_NUM_ARGS) {
+    return -1;
+  }
+
+  std::size_t currentPosition = 4;
+  while (count--) {
+    if (currentPosition + 4 > length) {
+      return -1;
+    }
+
+    std::uint32_t sizeOfData = 0;
+    std::memcpy(&sizeOfData, &requestData + currentPosition, 4);
+
+    if (currentPosition + 4 + sizeOfData > length) {
+      return -1;
+    }
+
+    outputData.emplace_back(
+        reinterpret_cast<char *>(&requestData + currentPosition + 4),
+        sizeOfData);
+
+    currentPosition += 4 + sizeOfData;
+  }
+
+  return currentPosition == length ? 0 : -1;
+}
+
+static auto request(std::int64_t valueSize) -> std::vector<std::uint8_t> {
+  return frame({"set", std::string(32, 'k'),
+                std::string(static_cast<std::size_t>(valueSize), 'v')});
+}
+
+static void BM_ParseOwning(benchmark::State &state) {
+  auto body = request(state.range(0));
+  for (auto _ : state) {
+    std::vector<std::string> command;
+    parseOwning(*body.data(), body.size(), command);
+    benchmark::DoNotOptimize(command.data());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) *
+                          static_cast<std::int64_t>(body.size()));
+}
+
+static void BM_ParseViews(benchmark::State &state) {
+  auto body = request(state.range(0));
+  Request parser;
+  for (auto _ : state) {
+    Arguments command;
+    parser.parse(*body.data(), body.size(), command);
+    benchmark::DoNotOptimize(command.begin());
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) *
+                          static_cast<std::int64_t>(body.size()));
+}
+
+BENCHMARK(BM_ParseOwning)->Arg(8)->Arg(128)->Arg(4096);
+BENCHMARK(BM_ParseViews)->Arg(8)->Arg(128)->Arg(4096);
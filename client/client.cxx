@@ -123,10 +123,10 @@ auto Client::sendRequest(std::int64_t fd, const CommandList &commands) const
     return -1;
   }
 
-  std::vector<char> writeBuffer(4 + MAX_MESSAGE_SIZE);
+  std::string writeBuffer(4 + messageLength, '\0');
   std::memcpy(writeBuffer.data(), &messageLength, 4);
   std::uint32_t n = commands.size();
-  std::memcpy(writeBuffer.data() + 4, &n, messageLength);
+  std::memcpy(writeBuffer.data() + 4, &n, 4);
 
   std::size_t current = 8;
   for (const auto &s : commands) {
@@ -136,8 +136,7 @@ auto Client::sendRequest(std::int64_t fd, const CommandList &commands) const
     current += 4 + s.size();
   }
 
-  std::string writeBufferString(writeBuffer.begin(), writeBuffer.end());
-  return socket.writeAll(fd, writeBufferString, 4 + messageLength);
+  return socket.writeAll(fd, writeBuffer, 4 + messageLength);
 }
 
 /**
@@ -153,7 +152,6 @@ auto Client::sendRequest(std::int64_t fd, const CommandList &commands) const
 auto Client::readResponse(std::int64_t fd) const -> std::int32_t {
   // 4 bytes header
   std::string header(4, '\0');
-  std::vector<char> readBuffer(4 + MAX_MESSAGE_SIZE + 1);
   auto readError = socket.readFull(fd, header, 4);
   errno = 0;
   if (readError) {
@@ -165,11 +163,8 @@ auto Client::readResponse(std::int64_t fd) const -> std::int32_t {
     return readError;
   }
 
-  // Copy the header back into readBuffer
-  std::memcpy(readBuffer.data(), header.data(), 4);
-
   std::uint32_t messageLength = 0;
-  std::memcpy(&messageLength, readBuffer.data(), 4);
+  std::memcpy(&messageLength, header.data(), 4);
   if (messageLength > MAX_MESSAGE_SIZE) {
     std::println("too long");
     return -1;
@@ -183,12 +178,8 @@ auto Client::readResponse(std::int64_t fd) const -> std::int32_t {
     return readError;
   }
 
-  // Copy the body back into readBuffer
-  std::memcpy(readBuffer.data() + 4, responseBody.data(), messageLength);
-
   // Print the result
-  auto responseValue =
-      deserialize(std::string_view(readBuffer.data() + 4, messageLength));
+  auto responseValue = deserialize(responseBody);
   if (responseValue > 0 &&
       static_cast<std::uint32_t>(responseValue) != messageLength) {
     std::println("bad response");
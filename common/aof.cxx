@@ -0,0 +1,282 @@
+#include "aof.hxx"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// writes all of `data`, through short writes and interrupts
+auto writeAll(int fd, std::string_view data) -> bool {
+  while (!data.empty()) {
+    auto n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+class Log {
+public:
+  Log(int fd, Fsync policy)
+      : fd(fd), policy(policy), goodSize(::lseek(fd, 0, SEEK_END)) {
+    if (policy == Fsync::EVERYSEC) {
+      syncer = std::jthread([this](std::stop_token stop) { syncEvery(stop); });
+    }
+  }
+
+  Log(const Log &) = delete;
+  auto operator=(const Log &) -> Log & = delete;
+
+  ~Log() {
+    syncer = {}; // joins, before the file goes
+    ::close(fd);
+  }
+
+  void append(std::span<const std::string_view> args) {
+    auto size = static_cast<std::uint32_t>(4);
+    for (auto arg : args) {
+      size += 4 + static_cast<std::uint32_t>(arg.size());
+    }
+    auto count = static_cast<std::uint32_t>(args.size());
+
+    std::scoped_lock lock(bufferMutex);
+    pending.append(reinterpret_cast<const char *>(&size), 4);
+    pending.append(reinterpret_cast<const char *>(&count), 4);
+    for (auto arg : args) {
+      auto len = static_cast<std::uint32_t>(arg.size());
+      pending.append(reinterpret_cast<const char *>(&len), 4);
+      pending.append(arg);
+    }
+  }
+
+  auto flush() -> bool {
+    std::scoped_lock io(writeMutex); // after this, the flush before us is done
+    {
+      std::scoped_lock lock(bufferMutex);
+      if (pending.empty() && !failing) {
+        return true;
+      }
+      std::swap(pending, writing); // appending goes on during the write
+    }
+
+    bool ok = writeAll(fd, writing);
+    if (ok && (policy == Fsync::ALWAYS || failing)) {
+      ok = ::fdatasync(fd) == 0; // also retries a failed background sync
+      fsyncs++;
+    }
+    writes++;
+    if (!ok) {
+      // cut a partial frame off, and keep the commands for the next try
+      errors++;
+      failing = true;
+      static_cast<void>(::ftruncate(fd, goodSize));
+      std::scoped_lock lock(bufferMutex);
+      pending.insert(0, writing);
+      writing.clear();
+      return false;
+    }
+    goodSize += static_cast<off_t>(writing.size());
+    writtenBytes += writing.size();
+    failing = false;
+    writing.clear(); // keeps its capacity for the next flush
+    return true;
+  }
+
+  auto isFailing() const -> bool { return failing; }
+
+  auto stats() const -> AofStats {
+    return {.writtenBytes = writtenBytes,
+            .writes = writes,
+            .fsyncs = fsyncs,
+            .errors = errors};
+  }
+
+private:
+  void syncEvery(const std::stop_token &stop) {
+    std::mutex mutex;
+    std::condition_variable_any tick;
+    std::uint64_t synced = 0;
+    std::unique_lock lock(mutex);
+    while (!tick.wait_for(lock, stop, AOF_FSYNC_PERIOD,
+                          [&stop] { return stop.stop_requested(); })) {
+      auto written = writtenBytes.load();
+      if (written == synced) {
+        continue; // nothing new
+      }
+      fsyncs++;
+      if (::fdatasync(fd) != 0) {
+        errors++;
+        failing = true; // until a flush syncs
+        continue;
+      }
+      synced = written;
+    }
+  }
+
+  int fd;
+  Fsync policy;
+  std::mutex bufferMutex;
+  std::string pending; // appended since the last flush
+  std::mutex writeMutex;
+  std::string writing; // being written by a flush
+  off_t goodSize;      // the file up to the end of the last whole flush
+  std::atomic<bool> failing = false; // a write or sync failed, not retried
+  std::atomic<std::uint64_t> writtenBytes = 0;
+  std::atomic<std::uint64_t> writes = 0;
+  std::atomic<std::uint64_t> fsyncs = 0;
+  std::atomic<std::uint64_t> errors = 0;
+  std::jthread syncer; // last, it starts running in the constructor
+};
+
+enum class Frame { WHOLE, TORN, BAD };
+
+// whether the `have` bytes of a frame payload of `length` bytes are all of
+// it, the start of it, or can not be one: u32 count, then u32 length and
+// bytes each argument, filling the payload exactly
+auto checkFrame(std::span<const std::uint8_t> have, std::uint32_t length)
+    -> Frame {
+  if (length < 4) {
+    return Frame::BAD;
+  }
+  if (have.size() < 4) {
+    return Frame::TORN;
+  }
+  std::uint32_t count = 0;
+  std::memcpy(&count, have.data(), 4);
+  std::size_t at = 4;
+  for (; count > 0; --count) {
+    if (at + 4 > length) {
+      return Frame::BAD;
+    }
+    if (at + 4 > have.size()) {
+      return Frame::TORN;
+    }
+    std::uint32_t len = 0;
+    std::memcpy(&len, have.data() + at, 4);
+    at += 4 + static_cast<std::size_t>(len);
+    if (at > length) {
+      return Frame::BAD;
+    }
+    if (at > have.size()) {
+      return Frame::TORN;
+    }
+  }
+  if (at != length) {
+    return Frame::BAD;
+  }
+  return have.size() == length ? Frame::WHOLE : Frame::TORN;
+}
+
+std::unique_ptr<Log> openLog; // set once, before the reactors start
+
+} // namespace
+
+namespace aof {
+
+void open(const std::string &path, Fsync policy) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open append-only log " + path);
+  }
+  openLog = std::make_unique<Log>(fd, policy);
+}
+
+auto enabled() -> bool { return openLog != nullptr; }
+
+void append(std::span<const std::string_view> args) { openLog->append(args); }
+
+auto flush() -> bool { return !openLog || openLog->flush(); }
+
+auto failing() -> bool { return openLog && openLog->isFailing(); }
+
+auto stats() -> AofStats { return openLog ? openLog->stats() : AofStats{}; }
+
+auto replay(const std::string &path,
+            const std::function<void(std::span<std::uint8_t>)> &fn)
+    -> std::uint64_t {
+  int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return 0; // nothing logged yet
+    }
+    throw std::runtime_error("Failed to open append-only log " + path);
+  }
+  struct Closer {
+    int fd;
+    ~Closer() { ::close(fd); }
+  } closer{fd}; // however the replay ends
+
+  std::vector<std::uint8_t> data;
+  std::size_t start = 0; // of the first frame not handled yet
+  off_t whole = 0;       // file bytes up to the end of the last whole frame
+  std::uint64_t commands = 0;
+  while (true) {
+    // move the partial frame to the front and read behind it
+    data.erase(data.begin(),
+               data.begin() + static_cast<std::ptrdiff_t>(start));
+    start = 0;
+    auto size = data.size();
+    data.resize(size + AOF_READ_SIZE);
+    ssize_t n = 0;
+    do {
+      n = ::read(fd, data.data() + size, AOF_READ_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+      throw std::runtime_error("Failed to read append-only log " + path);
+    }
+    data.resize(size + static_cast<std::size_t>(n));
+    if (n == 0) {
+      break;
+    }
+
+    while (data.size() - start >= 4) {
+      std::uint32_t length = 0;
+      std::memcpy(&length, data.data() + start, 4);
+      auto have = std::min<std::size_t>(data.size() - start - 4, length);
+      auto frame = checkFrame({data.data() + start + 4, have}, length);
+      if (frame == Frame::BAD) {
+        throw std::runtime_error("Corrupt append-only log " + path +
+                                 " at byte " + std::to_string(whole));
+      }
+      if (frame == Frame::TORN) {
+        break; // the rest comes with the next read, or the file ended
+      }
+      fn({data.data() + start + 4, length});
+      start += 4 + length;
+      whole += 4 + static_cast<off_t>(length);
+      commands++;
+    }
+  }
+
+  // only the last frame can be torn, the others were all whole
+  if (!data.empty()) {
+    if (::ftruncate(fd, whole) != 0) {
+      throw std::runtime_error("Failed to cut the append-only log " + path);
+    }
+    std::cerr << "Cut a torn command of " << data.size()
+              << " bytes off the append-only log " << path << '\n';
+  }
+  return commands;
+}
+
+} // namespace aof
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+
+/**
+ * @enum Fsync
+ * @brief When the append-only log is synced to disk.
+ *
+ */
+enum class Fsync : std::uint8_t {
+  ALWAYS = 0,   /** After every flush, before any of its replies go out */
+  EVERYSEC = 1, /** Once a second, on a background thread */
+  NO = 2,       /** When the kernel gets to it */
+};
+
+constexpr std::chrono::seconds AOF_FSYNC_PERIOD{1}; // for Fsync::EVERYSEC
+constexpr std::size_t AOF_READ_SIZE = 1 << 20;      // bytes per read at replay
+constexpr std::int32_t AOF_RETRY_MS = 100; // between flushes of a failing log
+
+/**
+ * @struct AofStats
+ * @brief A snapshot of the append-only log counters.
+ *
+ */
+struct AofStats {
+  std::uint64_t writtenBytes = 0; /** Bytes written to the log */
+  std::uint64_t writes = 0;       /** write() calls, one per flush */
+  std::uint64_t fsyncs = 0;       /** Syncs of the log to disk */
+  std::uint64_t errors = 0;       /** Failed writes or syncs */
+};
+
+/**
+ * An append-only log of the write commands, in the request framing.
+ *
+ * Commands are appended to a buffer as they run, and a reactor flushes the
+ * buffer with one write() before it sends any of the replies of a loop
+ * iteration. With Fsync::ALWAYS the flush also syncs, so every command that
+ * ran while a sync was in progress shares the next one: a group commit.
+ *
+ * Any thread may append and flush. A flush waits for the one in progress, so
+ * when it returns everything appended before it is in the log.
+ *
+ * A flush that fails cuts the file back to its last whole flush and keeps the
+ * commands for the next one. Until a flush succeeds the log is failing: the
+ * reactors hold every reply and the server refuses writes.
+ */
+namespace aof {
+
+/**
+ * @brief Starts logging to @p path, appending to what is there.
+ *
+ * @param path The log file.
+ * @param policy When the log is synced.
+ * @throws std::runtime_error If the file can not be opened.
+ */
+void open(const std::string &path, Fsync policy);
+
+/**
+ * @brief Get whether commands are logged.
+ *
+ * @return true once `open` succeeded.
+ */
+auto enabled() -> bool;
+
+/**
+ * @brief Appends a command to the buffer of the next flush.
+ *
+ * @param args The command and its arguments.
+ */
+void append(std::span<const std::string_view> args);
+
+/**
+ * @brief Writes the buffered commands, and syncs them with Fsync::ALWAYS.
+ *
+ * @return false if the write or sync failed, the commands stay buffered.
+ */
+auto flush() -> bool;
+
+/**
+ * @brief Get whether the last write or sync of the log failed.
+ *
+ * @return true until a flush succeeds again.
+ */
+auto failing() -> bool;
+
+/**
+ * @brief Get the counters of the log.
+ *
+ * @return how much was written and synced.
+ */
+auto stats() -> AofStats;
+
+/**
+ * @brief Reads every command of a log.
+ *
+ * A command cut short by the end of the file, by a crash in the middle of a
+ * write, is cut off the file. A frame anywhere that can not be a command stops
+ * the replay instead, and leaves the file as it is.
+ *
+ * @param path The log file.
+ * @param fn Called with the payload of every frame, the bytes after its
+ * length.
+ * @return how many commands were read, 0 if there is no file.
+ * @throws std::runtime_error If the file can not be read, or is corrupt.
+ */
+auto replay(const std::string &path,
+            const std::function<void(std::span<std::uint8_t>)> &fn)
+    -> std::uint64_t;
+
+} // namespace aof
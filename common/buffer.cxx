@@ -0,0 +1,186 @@
+#include "buffer.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+ChunkPool ChunkPool::shared;
+
+ChunkPool::~ChunkPool() {
+  for (auto &chunks : freeChunks) {
+    for (auto *chunk : chunks) {
+      delete[] chunk;
+    }
+  }
+}
+
+auto ChunkPool::acquire(std::size_t sizeClass) -> std::uint8_t * {
+  {
+    std::scoped_lock lock(mutex);
+    usedChunks[sizeClass]++;
+    auto &chunks = freeChunks[sizeClass];
+    if (!chunks.empty()) {
+      auto *chunk = chunks.back();
+      chunks.pop_back();
+      return chunk;
+    }
+  }
+  return new std::uint8_t[CHUNK_SIZES[sizeClass]];
+}
+
+void ChunkPool::release(std::size_t sizeClass, std::uint8_t *chunk) {
+  {
+    std::scoped_lock lock(mutex);
+    usedChunks[sizeClass]--;
+    auto &chunks = freeChunks[sizeClass];
+    if (chunks.size() * CHUNK_SIZES[sizeClass] < CHUNK_POOL_MAX_FREE_BYTES) {
+      chunks.push_back(chunk);
+      return;
+    }
+  }
+  delete[] chunk;
+}
+
+auto ChunkPool::stats() -> PoolStats {
+  std::scoped_lock lock(mutex);
+  PoolStats stats;
+  for (std::size_t i = 0; i < CHUNK_SIZES.size(); ++i) {
+    stats.used[i] = usedChunks[i];
+    stats.free[i] = freeChunks[i].size();
+  }
+  return stats;
+}
+
+ChunkedBuffer::~ChunkedBuffer() {
+  for (const auto &chunk : chunks) {
+    pool.release(chunk.sizeClass, chunk.data);
+  }
+}
+
+auto ChunkedBuffer::space() -> std::span<std::uint8_t> {
+  if (chunks.empty() || tail == chunkSize(chunks.size() - 1)) {
+    std::size_t sizeClass = std::min(chunks.size(), CHUNK_SIZES.size() - 1);
+    chunks.push_back({pool.acquire(sizeClass), sizeClass});
+    tail = 0;
+  }
+  return {chunks.back().data + tail, chunkSize(chunks.size() - 1) - tail};
+}
+
+void ChunkedBuffer::commit(std::size_t n) {
+  assert(!chunks.empty() && tail + n <= chunkSize(chunks.size() - 1));
+  tail += n;
+  bytes += n;
+}
+
+void ChunkedBuffer::appendScattered(const void *data, std::size_t n) {
+  const auto *src = static_cast<const std::uint8_t *>(data);
+  while (n) {
+    auto free = space();
+    std::size_t len = std::min(n, free.size());
+    std::memcpy(free.data(), src, len);
+    commit(len);
+    src += len;
+    n -= len;
+  }
+}
+
+/**
+ * @brief Calls @p fn with every contiguous span of the @p n buffered bytes
+ * starting at @p offset, in order.
+ */
+template <typename Fn>
+void ChunkedBuffer::forEachSpan(std::size_t offset, std::size_t n,
+                                Fn &&fn) const {
+  assert(offset + n <= bytes);
+  std::size_t position = head + offset;
+  std::size_t index = 0;
+  while (position >= chunkSize(index)) {
+    position -= chunkSize(index++);
+  }
+  while (n) {
+    std::size_t len = std::min(n, chunkSize(index) - position);
+    fn(chunks[index].data + position, len);
+    n -= len;
+    position = 0;
+    index++;
+  }
+}
+
+void ChunkedBuffer::copy(std::size_t offset, void *dst, std::size_t n) const {
+  auto *out = static_cast<std::uint8_t *>(dst);
+  forEachSpan(offset, n, [&out](std::uint8_t *span, std::size_t len) {
+    std::memcpy(out, span, len);
+    out += len;
+  });
+}
+
+void ChunkedBuffer::patch(std::size_t offset, const void *src, std::size_t n) {
+  const auto *in = static_cast<const std::uint8_t *>(src);
+  forEachSpan(offset, n, [&in](std::uint8_t *span, std::size_t len) {
+    std::memcpy(span, in, len);
+    in += len;
+  });
+}
+
+void ChunkedBuffer::truncate(std::size_t size) {
+  assert(size <= bytes);
+  while (bytes > size) {
+    std::size_t begin = chunks.size() == 1 ? head : 0;
+    std::size_t drop = std::min(bytes - size, tail - begin);
+    tail -= drop;
+    bytes -= drop;
+    if (tail == begin && chunks.size() > 1) {
+      pool.release(chunks.back().sizeClass, chunks.back().data);
+      chunks.pop_back();
+      tail = chunkSize(chunks.size() - 1);
+    }
+  }
+  shrink();
+}
+
+void ChunkedBuffer::consumeChunks(std::size_t n) {
+  assert(n <= bytes);
+  bytes -= n;
+  head += n;
+
+  if (bytes == 0) {
+    shrink(); // drained, an idle connection holds no chunk
+    return;
+  }
+
+  // hand the drained chunks back
+  std::size_t drained = 0;
+  while (head >= chunkSize(drained)) {
+    head -= chunkSize(drained);
+    pool.release(chunks[drained].sizeClass, chunks[drained].data);
+    drained++;
+  }
+  chunks.erase(chunks.begin(), chunks.begin() + drained);
+}
+
+void ChunkedBuffer::shrink() {
+  if (bytes) {
+    return;
+  }
+  for (const auto &chunk : chunks) {
+    pool.release(chunk.sizeClass, chunk.data);
+  }
+  chunks.clear();
+  head = 0;
+  tail = 0;
+}
+
+auto ChunkedBuffer::gather(std::span<iovec> iov) const -> std::size_t {
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < chunks.size() && count < iov.size(); ++i) {
+    std::size_t begin = i == 0 ? head : 0;
+    std::size_t end = i + 1 == chunks.size() ? tail : chunkSize(i);
+    if (begin == end) {
+      continue;
+    }
+    iov[count].iov_base = chunks[i].data + begin;
+    iov[count].iov_len = end - begin;
+    count++;
+  }
+  return count;
+}
@@ -0,0 +1,253 @@
+#pragma once
+#include <sys/uio.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <span>
+#include <vector>
+
+/**
+ * Chunk sizes served by the pool. The n-th chunk of a buffer comes from class
+ * n, the last class is used for the rest, so a buffer that only ever holds a
+ * few small requests never takes more than the smallest chunk.
+ */
+constexpr std::array<std::size_t, 3> CHUNK_SIZES = {4 * 1024, 16 * 1024,
+                                                    64 * 1024};
+constexpr std::size_t CHUNK_POOL_MAX_FREE_BYTES = 16 << 20; // per size class
+
+/**
+ * @struct PoolStats
+ * @brief A snapshot of the chunk counts of a ChunkPool, per size class.
+ *
+ */
+struct PoolStats {
+  std::array<std::size_t, CHUNK_SIZES.size()> used = {}; /** Held by buffers */
+  std::array<std::size_t, CHUNK_SIZES.size()> free = {}; /** Kept for reuse */
+};
+
+/**
+ * @class ChunkPool
+ * @brief Free lists of fixed size chunks, one per size class.
+ *
+ * Buffers take chunks while they hold bytes and give them back as soon as
+ * they drain, so recycling the chunks here keeps the allocator out of the
+ * request path. Safe to use from several reactor threads.
+ */
+class ChunkPool {
+public:
+  ChunkPool() = default;
+
+  /**
+   * @brief Destroy the ChunkPool object
+   *
+   * Frees the chunks that are on the free lists. Chunks still owned by a
+   * buffer are freed by that buffer.
+   */
+  ~ChunkPool();
+
+  ChunkPool(const ChunkPool &) = delete;
+  auto operator=(const ChunkPool &) -> ChunkPool & = delete;
+
+  /**
+   * @brief Takes a chunk of `CHUNK_SIZES[sizeClass]` bytes from the pool.
+   *
+   * @param sizeClass The index of the chunk size.
+   * @return the chunk, its contents are unspecified.
+   */
+  auto acquire(std::size_t sizeClass) -> std::uint8_t *;
+
+  /**
+   * @brief Gives a chunk back to the pool.
+   *
+   * At most CHUNK_POOL_MAX_FREE_BYTES per size class are kept, the rest is
+   * freed.
+   *
+   * @param sizeClass The size class the chunk was acquired with.
+   * @param chunk A chunk returned by `acquire()`.
+   */
+  void release(std::size_t sizeClass, std::uint8_t *chunk);
+
+  /**
+   * @brief Get the current chunk counts.
+   *
+   * @return how many chunks of every size class are in use and free.
+   */
+  auto stats() -> PoolStats;
+
+  /** The pool every connection buffer takes its chunks from. */
+  static ChunkPool shared;
+
+private:
+  std::mutex mutex;
+  std::array<std::vector<std::uint8_t *>, CHUNK_SIZES.size()> freeChunks;
+  std::array<std::size_t, CHUNK_SIZES.size()> usedChunks = {};
+};
+
+/**
+ * @class ChunkedBuffer
+ * @brief A byte queue made of chunks taken from a ChunkPool.
+ *
+ * Bytes are appended at the back and consumed from the front. The buffer
+ * grows one chunk at a time, so it never has to move the bytes it already
+ * holds, and a pointer into it stays valid until those bytes are consumed.
+ * Only the bytes of the first chunk are contiguous.
+ *
+ * An empty buffer owns no chunk at all.
+ */
+class ChunkedBuffer {
+public:
+  /**
+   * @brief Construct a new ChunkedBuffer object
+   *
+   * No chunk is taken until the first byte is written.
+   *
+   * @param pool The pool chunks are taken from and returned to.
+   */
+  explicit ChunkedBuffer(ChunkPool &pool) : pool(pool) {}
+
+  /**
+   * @brief Destroy the ChunkedBuffer object
+   *
+   * Returns every chunk to the pool.
+   */
+  ~ChunkedBuffer();
+
+  ChunkedBuffer(const ChunkedBuffer &) = delete;
+  auto operator=(const ChunkedBuffer &) -> ChunkedBuffer & = delete;
+
+  /**
+   * @brief Get the number of buffered bytes.
+   *
+   * @return the number of bytes that were written and not consumed yet.
+   */
+  auto size() const -> std::size_t { return bytes; }
+
+  /**
+   * @brief Get the bytes at the front that are stored contiguously.
+   *
+   * @return a view over the buffered bytes of the first chunk.
+   */
+  auto front() -> std::span<std::uint8_t> {
+    if (chunks.empty()) {
+      return {};
+    }
+    std::size_t end = chunks.size() == 1 ? tail : chunkSize(0);
+    return {chunks.front().data + head, end - head};
+  }
+
+  /**
+   * @brief Get the free space at the back of the buffer.
+   *
+   * Takes a new chunk from the pool if the last one is full. The bytes written
+   * into the space become part of the buffer with `commit()`. If nothing is
+   * written, `shrink()` hands an unused chunk back.
+   *
+   * @return a view over the free bytes of the last chunk, never empty.
+   */
+  auto space() -> std::span<std::uint8_t>;
+
+  /**
+   * @brief Appends @p n bytes that were written into `space()`.
+   *
+   * @param n The number of bytes written, at most `space().size()`.
+   */
+  void commit(std::size_t n);
+
+  /**
+   * @brief Appends a copy of @p n bytes at @p data.
+   *
+   * @param data The bytes to append.
+   * @param n The number of bytes to append.
+   */
+  void append(const void *data, std::size_t n) {
+    if (!chunks.empty() && n <= chunkSize(chunks.size() - 1) - tail)
+        [[likely]] {
+      std::memcpy(chunks.back().data + tail, data, n);
+      tail += n;
+      bytes += n;
+      return;
+    }
+    appendScattered(data, n);
+  }
+
+  /**
+   * @brief Copies @p n buffered bytes starting at @p offset out of the buffer.
+   *
+   * @param offset The position of the first byte, relative to the front.
+   * @param dst Where the bytes are copied to.
+   * @param n The number of bytes to copy, `offset + n` must be at most
+   * `size()`.
+   */
+  void copy(std::size_t offset, void *dst, std::size_t n) const;
+
+  /**
+   * @brief Overwrites @p n buffered bytes starting at @p offset.
+   *
+   * @param offset The position of the first byte, relative to the front.
+   * @param src The bytes to write.
+   * @param n The number of bytes to write, `offset + n` must be at most
+   * `size()`.
+   */
+  void patch(std::size_t offset, const void *src, std::size_t n);
+
+  /**
+   * @brief Drops the bytes at the back until @p size bytes are left.
+   *
+   * @param size The number of bytes to keep, at most `size()`.
+   */
+  void truncate(std::size_t size);
+
+  /**
+   * @brief Drops @p n bytes from the front.
+   *
+   * Chunks that are emptied go back to the pool, once the buffer is drained
+   * that includes the last one.
+   *
+   * @param n The number of bytes to drop, at most `size()`.
+   */
+  void consume(std::size_t n) {
+    if (n < bytes && head + n < chunkSize(0)) [[likely]] {
+      head += n;
+      bytes -= n;
+      return;
+    }
+    consumeChunks(n);
+  }
+
+  /**
+   * @brief Returns every chunk to the pool if no bytes are buffered.
+   *
+   */
+  void shrink();
+
+  /**
+   * @brief Describes the buffered bytes as an I/O vector.
+   *
+   * @param iov The vector to fill, one entry per chunk.
+   * @return the number of entries filled in, the bytes of chunks that did not
+   * fit are left out.
+   */
+  auto gather(std::span<iovec> iov) const -> std::size_t;
+
+private:
+  struct Chunk {
+    std::uint8_t *data;
+    std::size_t sizeClass;
+  };
+
+  auto chunkSize(std::size_t index) const -> std::size_t {
+    return CHUNK_SIZES[chunks[index].sizeClass];
+  }
+  template <typename Fn>
+  void forEachSpan(std::size_t offset, std::size_t n, Fn &&fn) const;
+  void appendScattered(const void *data, std::size_t n);
+  void consumeChunks(std::size_t n);
+
+  ChunkPool &pool;
+  std::vector<Chunk> chunks;
+  std::size_t head = 0;  // offset of the first byte in the first chunk
+  std::size_t tail = 0;  // bytes used in the last chunk
+  std::size_t bytes = 0; // bytes between head and tail
+};
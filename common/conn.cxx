@@ -1,74 +1,114 @@
 #include "conn.hxx"
 
+#include <algorithm>
+#include <array>
 #include <utility>
 
 Connection::~Connection() { close(_fd); }
 
-auto Connection::tryOneRequest() -> bool {
-  if (readBufferSize < 4) {
+auto Connection::processRequest() -> bool {
+  std::size_t availableSize = readBuffer.size();
+  if (availableSize < 4) {
     // Not enough data in the buffer, will retry next iteration.
     return false;
   }
 
+  auto front = readBuffer.front();
   std::uint32_t messageLength = 0;
-  std::memcpy(&messageLength, readBuffer.data(), 4);
-  if (messageLength > MAX_MESSAGE_SIZE) {
+  if (front.size() >= 4) [[likely]] {
+    std::memcpy(&messageLength, front.data(), 4);
+  } else {
+    readBuffer.copy(0, &messageLength, 4);
+  }
+  if (messageLength > maxMessageSize) {
     std::println("too long");
     state = ConnectionState::END;
     return false;
   }
 
-  if (4 + messageLength > readBufferSize) {
+  if (4 + messageLength > availableSize) {
     return false; // not enough data in the buffer;
   }
 
-  std::uint8_t &requestData = *(readBuffer.data() + 4);
+  // parse the frame in place when it sits in one chunk, which every frame
+  // smaller than a chunk does unless it straddles a chunk boundary
+  std::vector<std::uint8_t> scattered;
+  std::uint8_t *frame = front.data() + 4;
+  if (front.size() < 4 + messageLength) [[unlikely]] {
+    scattered.resize(messageLength);
+    readBuffer.copy(4, scattered.data(), messageLength);
+    frame = scattered.data();
+  }
+  std::uint8_t &requestData = *frame;
 
   // parse the request
-  std::vector<std::string> command;
+  Arguments command; // views into the frame, valid until it is consumed
   if (0 != request.parse(requestData, messageLength, command)) {
     std::println("bad request");
     state = ConnectionState::END;
     return false;
   }
 
-  // got one request, generate the response
-  std::string output;
+  // got one request, answer it straight into the write buffer, behind the
+  // responses that are not sent yet
+  Output output(writeBuffer);
   request(command, output);
-
-  // pack the response into the buffer
-  if (4 + output.size() > MAX_MESSAGE_SIZE) {
+  if (output.size() > maxMessageSize) {
     output.clear();
     out::err(output, std::to_underlying(Error::TOO_BIG), "response is too big");
   }
+  output.finish();
 
-  auto writeLength = static_cast<std::uint32_t>(output.size());
-  std::memcpy(writeBuffer.data(), &writeLength, 4);
-  std::memcpy(writeBuffer.data() + 4, output.data(), output.size());
-  writeBufferSize = 4 + writeLength;
-
-  // TODO: frequent memmove is efficient, need better handling
-  std::size_t remainingSize = readBufferSize - 4 - messageLength;
-  if (remainingSize) {
-    std::memmove(readBuffer.data(), readBuffer.data() + 4 + messageLength,
-                 remainingSize);
-  }
-  readBufferSize = remainingSize;
+  // consume the frame
+  readBuffer.consume(4 + messageLength);
 
   // change state
   state = ConnectionState::RES;
-  stateResponse();
+  return true;
+}
+
+void Connection::processRequests() {
+  while (writeBuffer.size() < OUTPUT_HIGH_WATER && processRequest()) {
+    // answering every complete request in the read buffer
+  }
+}
 
-  // continue to the outer loop if the request was fully processed
-  return (state == ConnectionState::REQ);
+auto Connection::feed(const std::uint8_t *data, std::size_t size)
+    -> std::size_t {
+  std::size_t limit = 4 + maxMessageSize + MAX_PIPELINED_INPUT;
+  std::size_t n =
+      std::min(size, limit - std::min(limit, readBuffer.size()));
+  readBuffer.append(data, n);
+  return n;
+}
+
+auto Connection::pendingOutputSize() const -> std::size_t {
+  return writeBuffer.size();
+}
+
+auto Connection::pendingOutput(std::span<iovec> iov) const -> std::size_t {
+  return writeBuffer.gather(iov);
+}
+
+void Connection::consumeOutput(std::size_t n) {
+  assert(n <= writeBuffer.size());
+  writeBuffer.consume(n);
+
+  if (writeBuffer.size() == 0) {
+    state = ConnectionState::REQ;
+  }
 }
 
 auto Connection::tryFlushBuffer() -> bool {
+  if (writeBuffer.size() == 0) {
+    return false; // nothing queued
+  }
+
+  std::array<iovec, MAX_OUTPUT_IOVECS> iov;
+  auto count = static_cast<int>(pendingOutput(iov));
   ssize_t writtenBytes = 0;
   do {
-    std::size_t remainingSize = writeBufferSize - writeBufferSent;
-    writtenBytes =
-        write(_fd, writeBuffer.data() + writeBufferSent, remainingSize);
+    writtenBytes = writev(_fd, iov.data(), count);
   } while (writtenBytes < 0 && errno == EINTR);
 
   if (writtenBytes < 0 && errno == EAGAIN) {
@@ -81,32 +121,23 @@ auto Connection::tryFlushBuffer() -> bool {
     return false;
   }
 
-  writeBufferSent += static_cast<std::size_t>(writtenBytes);
-  assert(writeBufferSent <= writeBufferSize);
-
-  if (writeBufferSent == writeBufferSize) {
-    state = ConnectionState::REQ;
-    writeBufferSent = 0;
-    writeBufferSize = 0;
-    return false;
-  }
+  consumeOutput(static_cast<std::size_t>(writtenBytes));
 
   // still got some data in the write buffer, could try to write again
-  return true;
+  return (state == ConnectionState::RES);
 }
 
 auto Connection::tryFillBuffer() -> bool {
-  assert(readBufferSize < readBuffer.capacity());
+  auto space = readBuffer.space();
   ssize_t readBytes = 0;
 
   do {
-    std::size_t availableCapacity = readBuffer.capacity() - readBufferSize;
-    readBytes =
-        read(_fd, readBuffer.data() + readBufferSize, availableCapacity);
+    readBytes = read(_fd, space.data(), space.size());
   } while (readBytes < 0 && errno == EINTR);
 
   if (readBytes < 0 && errno == EAGAIN) {
-    return false; // stop
+    readBuffer.shrink(); // nothing arrived, an idle connection keeps no chunk
+    return false;        // stop
   }
 
   if (readBytes < 0) {
@@ -116,7 +147,7 @@ auto Connection::tryFillBuffer() -> bool {
   }
 
   if (readBytes == 0) {
-    if (readBufferSize > 0) {
+    if (readBuffer.size() > 0) {
       std::println("unexpected EOF");
     } else {
       std::println("EOF");
@@ -125,19 +156,8 @@ auto Connection::tryFillBuffer() -> bool {
     return false;
   }
 
-  readBufferSize += static_cast<std::size_t>(readBytes);
-  assert(readBufferSize <= readBuffer.capacity());
-
-  while (tryOneRequest()) {
-    // trying a request
-  }
-  return (state == ConnectionState::REQ);
-}
-
-void Connection::stateRequest() {
-  while (tryFillBuffer()) {
-    // trying to read into buffer
-  }
+  readBuffer.commit(static_cast<std::size_t>(readBytes));
+  return true;
 }
 
 void Connection::stateResponse() {
@@ -160,13 +180,26 @@ auto Connection::getFd() const -> int { return _fd; }
  */
 auto Connection::getState() const -> ConnectionState { return state; }
 
-void Connection::io() {
-  if (state == ConnectionState::REQ) {
-    stateRequest();
-  } else if (state == ConnectionState::RES) {
-    stateResponse();
-  } else [[unlikely]] {
-    std::println("not expected");
-    assert(0);
+void Connection::receive() {
+  // read and answer requests until the socket runs dry, the responses wait
+  // for send()
+  stalled = false;
+  while (state != ConnectionState::END) {
+    processRequests();
+
+    if (writeBuffer.size() >= OUTPUT_HIGH_WATER) {
+      stalled = true; // these go out first
+      return;
+    }
+
+    if (!tryFillBuffer()) {
+      break;
+    }
   }
-}
\ No newline at end of file
+}
+
+auto Connection::send() -> bool {
+  // on EOF still try to deliver what was answered before
+  stateResponse();
+  return stalled && state != ConnectionState::END && writeBuffer.size() == 0;
+}
@@ -9,18 +9,35 @@
 #include <map>
 #include <memory>
 #include <print>
+#include <span>
 #include <vector>
 
+#include "buffer.hxx"
 #include "req.hxx"
 
+/**
+ * Once this many response bytes are queued, the connection stops handling
+ * requests until the peer has read some of them.
+ */
+constexpr std::size_t OUTPUT_HIGH_WATER = 64 * 1024;
+
+/**
+ * Requests a connection buffers on top of one frame of the maximum size while
+ * it waits for the peer to read its responses.
+ */
+constexpr std::size_t MAX_PIPELINED_INPUT = 1 << 20;
+
+/** Chunks written with one writev(). */
+constexpr std::size_t MAX_OUTPUT_IOVECS = 16;
+
 /**
  * @enum ConnectionState
  * @brief Represents the state of a connection.
  *
  */
 enum class ConnectionState : std::uint8_t {
-  REQ = 0, /** Request state */
-  RES = 1, /** Response state */
+  REQ = 0, /** Request state, no response is waiting to be sent */
+  RES = 1, /** Response state, responses are queued for sending */
   END = 2, /** End State */
 };
 
@@ -36,27 +53,24 @@ public:
    *
    */
   Connection()
-      : _fd(-1), state(ConnectionState::REQ), readBuffer(), writeBuffer(),
-        writeBufferSent(0), writeBufferSize(0), readBufferSize(0) {
-    readBuffer.reserve(4 + MAX_MESSAGE_SIZE);
-    writeBuffer.reserve(4 + MAX_MESSAGE_SIZE);
-  }
+      : _fd(-1), state(ConnectionState::REQ), maxMessageSize(MAX_MESSAGE_SIZE),
+        readBuffer(ChunkPool::shared), writeBuffer(ChunkPool::shared) {}
 
   /**
    * @brief Construct a new Connection object
    *
+   * The buffers take their chunks from a pool shared by every connection only
+   * while they hold bytes, and grow as needed up to one frame of
+   * @p maxMessageSize bytes. An idle connection owns no buffer memory.
+   *
    * @param fd File descriptor for the connection
    * @param state Initial state of the connection
-   * @param writeBufferSent Number of bytes sent in the write buffer
+   * @param maxMessageSize Largest request or response accepted, in bytes
    */
   Connection(std::int64_t fd, ConnectionState state,
-             std::size_t writeBufferSent)
-      : _fd(fd), state(state), readBuffer(), writeBuffer(),
-        writeBufferSent(writeBufferSent), writeBufferSize(0),
-        readBufferSize(0) {
-    readBuffer.reserve(4 + MAX_MESSAGE_SIZE);
-    writeBuffer.reserve(4 + MAX_MESSAGE_SIZE);
-  }
+             std::size_t maxMessageSize = MAX_MESSAGE_SIZE)
+      : _fd(fd), state(state), maxMessageSize(maxMessageSize),
+        readBuffer(ChunkPool::shared), writeBuffer(ChunkPool::shared) {}
 
   /**
    * @brief Destroy the Connection object
@@ -79,20 +93,87 @@ public:
    */
   auto getState() const -> ConnectionState;
 
-  void io();
+  /**
+   * @brief Handles readiness of the connection file descriptor.
+   *
+   * Reads until the socket runs dry and answers every complete request on the
+   * way, or stops once OUTPUT_HIGH_WATER bytes of responses are queued. The
+   * responses stay queued for `send()`, so the append-only log can be flushed
+   * before any of them goes out.
+   */
+  void receive();
+
+  /**
+   * @brief Writes all queued responses at once, instead of one write per
+   * request.
+   *
+   * @return true if `receive()` stopped at OUTPUT_HIGH_WATER and everything
+   * was sent, so it has to run again without waiting for readiness.
+   */
+  auto send() -> bool;
+
+  /**
+   * @brief Copies received bytes into the read buffer.
+   *
+   * Used by I/O backends that receive data on their own instead of letting the
+   * connection `read()` from its file descriptor.
+   *
+   * At most one frame of the maximum size plus MAX_PIPELINED_INPUT bytes are
+   * buffered, a peer that sends more without reading is misbehaving.
+   *
+   * @param data The received bytes.
+   * @param size The number of received bytes.
+   * @return the number of bytes that fit into the read buffer.
+   */
+  auto feed(const std::uint8_t *data, std::size_t size) -> std::size_t;
+
+  /**
+   * @brief Handles every complete request in the read buffer.
+   *
+   * The responses are queued back to back in the write buffer, so they can be
+   * sent with a single write. Stops early once OUTPUT_HIGH_WATER bytes are
+   * waiting to be sent.
+   *
+   * Queued output never moves, so this may run while a send of
+   * `pendingOutput()` is in flight.
+   */
+  void processRequests();
+
+  /**
+   * @brief Get the number of response bytes that are waiting to be sent.
+   *
+   * @return the size of every queued, unsent response.
+   */
+  auto pendingOutputSize() const -> std::size_t;
+
+  /**
+   * @brief Describes the response bytes that are waiting to be sent.
+   *
+   * @param iov The I/O vector to fill in, one entry per buffer chunk.
+   * @return the number of entries filled in.
+   */
+  auto pendingOutput(std::span<iovec> iov) const -> std::size_t;
+
+  /**
+   * @brief Marks @p n bytes of the pending output as sent.
+   *
+   * Once every queued response is sent the connection goes back to the
+   * request state.
+   *
+   * @param n The number of bytes that were sent.
+   */
+  void consumeOutput(std::size_t n);
 
 private:
   std::int64_t _fd;
   ConnectionState state;
-  std::vector<std::uint8_t> readBuffer;
-  std::vector<std::uint8_t> writeBuffer;
-  std::size_t writeBufferSent;
-  std::size_t writeBufferSize;
-  std::size_t readBufferSize;
+  bool stalled = false; // receive() stopped at the high water mark
+  std::size_t maxMessageSize;
+  ChunkedBuffer readBuffer;
+  ChunkedBuffer writeBuffer;
   Request request;
-  auto tryOneRequest() -> bool;
+  auto processRequest() -> bool;
   auto tryFlushBuffer() -> bool;
   auto tryFillBuffer() -> bool;
-  void stateRequest();
   void stateResponse();
 };
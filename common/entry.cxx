@@ -1,34 +1,132 @@
-
 #include "entry.hxx"
+#include "common/slab.hxx"
+
+#include <cassert>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// the number, if `val` is the canonical spelling of one
+static auto intEncoding(std::string_view val, std::int64_t &num) -> bool {
+  if (val.empty() || val.size() > MAX_INT_DIGITS) {
+    return false;
+  }
+  const auto *end = val.data() + val.size();
+  auto [ptr, ec] = std::from_chars(val.data(), end, num);
+  if (ec != std::errc{} || ptr != end) {
+    return false;
+  }
 
-auto entryEquality(Node *lhs, Node *rhs) -> bool {
-  const auto *le = containerOf(lhs, Entry, node);
-  const auto *re = containerOf(rhs, Entry, node);
-  return le->key == re->key;
+  // "007" or "-0" would not come back the same
+  std::array<char, MAX_INT_DIGITS> scratch{};
+  auto [last, _] = std::to_chars(scratch.begin(), scratch.end(), num);
+  return std::string_view(scratch.data(), last) == val;
 }
 
-void entryDelete(const Entry &entry) {
-  auto type = static_cast<KeyType>(entry.type);
+auto Entry::create(std::string_view key) -> Entry * {
+  void *memory = slab::allocate(sizeof(Entry) + key.size());
+  auto *entry = new (memory) Entry(static_cast<std::uint32_t>(key.size()));
+  std::memcpy(reinterpret_cast<char *>(entry + 1), key.data(), key.size());
+  return entry;
+}
 
-  switch (type) {
-  case KeyType::ZSET:
-    zset::dispose(entry.set.get());
-    break;
-  case KeyType::STR:
+void Entry::destroy(Entry *entry) {
+  if (!entry) {
     return;
   }
+  assert(!entry->heapIndex && "remove the deadline first");
+  std::size_t size = sizeof(Entry) + entry->keySize;
+  entry->~Entry();
+  slab::deallocate(entry, size);
+}
+
+void Entry::clearValue() {
+  switch (encoding) {
+  case Encoding::HEAP:
+    std::free(value.heap.data);
+    break;
+  case Encoding::ZSET:
+    zset::dispose(&value.set);
+    break;
+  case Encoding::INLINE:
+  case Encoding::INT:
+    break;
+  }
+  encoding = Encoding::INLINE;
+  inlineSize = 0;
 }
 
-void scan(const Table &table, const std::function<void(Node *, void *)> &fn,
-          void *arg) {
-  if (table.size == 0)
+void Entry::setString(std::string_view val) {
+  std::int64_t num = 0;
+  if (intEncoding(val, num)) { // before the buffer reuse, numbers are INT
+    setInteger(num);
+    return;
+  }
+
+  auto size = static_cast<std::uint32_t>(val.size());
+  if (encoding == Encoding::HEAP && size > INLINE_VALUE_SIZE &&
+      size <= value.heap.capacity) {
+    std::memcpy(value.heap.data, val.data(), size); // reuse the buffer
+    value.heap.size = size;
     return;
+  }
+
+  clearValue();
+  if (size <= INLINE_VALUE_SIZE) {
+    encoding = Encoding::INLINE;
+    inlineSize = static_cast<std::uint8_t>(size);
+    std::memcpy(value.inlined, val.data(), size);
+  } else {
+    encoding = Encoding::HEAP;
+    value.heap.data = static_cast<char *>(std::malloc(size));
+    value.heap.size = size;
+    value.heap.capacity = size;
+    std::memcpy(value.heap.data, val.data(), size);
+  }
+}
+
+void Entry::setInteger(std::int64_t num) {
+  if (encoding != Encoding::INT) {
+    clearValue();
+    encoding = Encoding::INT;
+  }
+  value.num = num;
+}
+
+auto Entry::string(std::array<char, MAX_INT_DIGITS> &scratch) const
+    -> std::string_view {
+  switch (encoding) {
+  case Encoding::INLINE:
+    return {value.inlined, inlineSize};
+  case Encoding::HEAP:
+    return {value.heap.data, value.heap.size};
+  case Encoding::INT: {
+    auto [last, _] = std::to_chars(scratch.begin(), scratch.end(), value.num);
+    return {scratch.data(), last};
+  }
+  case Encoding::ZSET:
+    break;
+  }
+  return {};
+}
 
-  for (std::size_t i = 0; i < table.mask + 1; ++i) {
-    auto *node = table.table[i];
-    while (node) {
-      fn(node, arg);
-      node = node->next;
-    }
+void Entry::setZSet() {
+  clearValue();
+  encoding = Encoding::ZSET;
+  value.set = {};
+}
+
+auto Entry::memory() const -> std::size_t {
+  std::size_t size = slab::allocationSize(sizeof(Entry) + keySize);
+  switch (encoding) {
+  case Encoding::HEAP:
+    return size + value.heap.capacity;
+  case Encoding::ZSET:
+    return size + zset::memory(&value.set);
+  case Encoding::INLINE:
+  case Encoding::INT:
+    break;
   }
-}
\ No newline at end of file
+  return size;
+}
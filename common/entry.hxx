@@ -1,10 +1,12 @@
 #pragma once
 
-#include <functional>
-#include <memory>
-#include <string>
+#include <array>
+#include <cstdint>
+#include <string_view>
 
-#include "map/c/wrap.hxx"
+#include "common/evict.hxx"
+#include "hash/hash.hxx"
+#include "map/cxx/intrusive.hxx"
 #include "zset/zset.hxx"
 
 enum class KeyType : std::uint8_t {
@@ -12,14 +14,157 @@ enum class KeyType : std::uint8_t {
   ZSET = 1,
 };
 
-struct Entry {
-  Node node;
-  std::string key;
-  std::uint32_t type = 0;
-  std::string val;
-  std::unique_ptr<ZSet> set = nullptr;
+constexpr std::size_t INLINE_VALUE_SIZE = 16;
+constexpr std::size_t MAX_INT_DIGITS = 20; // "-9223372036854775808"
+
+/**
+ * @class Entry
+ * @brief A key and its value in a single allocation.
+ *
+ * The key bytes follow the 40 byte header, so a lookup compares the key on
+ * the cache line it already loaded for the hash. The value is a tagged union:
+ * a string that spells an int64 is kept as the number, other strings of up to
+ * INLINE_VALUE_SIZE bytes in place and longer ones on the heap, and a zset as
+ * its two pointers.
+ *
+ * Entries are made with `create` and freed with `destroy`.
+ */
+class Entry {
+public:
+  HashNode node;
+  std::uint32_t heapIndex = 0; /** Position in the deadline heap, 0 if none */
+  std::uint32_t access : ACCESS_BITS = 0; /** LRU clock or LFU counter */
+
+  /**
+   * @brief Allocates an entry for @p key holding an empty string.
+   *
+   * @param key The key, copied inline.
+   * @return the new entry.
+   */
+  static auto create(std::string_view key) -> Entry *;
+
+  /**
+   * @brief Frees @p entry and its value.
+   *
+   * @param entry An entry from `create`, or nullptr.
+   */
+  static void destroy(Entry *entry);
+
+  Entry(const Entry &) = delete;
+  auto operator=(const Entry &) -> Entry & = delete;
+
+  auto key() const -> std::string_view {
+    return {reinterpret_cast<const char *>(this + 1), keySize};
+  }
+
+  auto type() const -> KeyType {
+    return encoding == Encoding::ZSET ? KeyType::ZSET : KeyType::STR;
+  }
+
+  /**
+   * @brief Replaces the value with a string, whatever it held before.
+   *
+   * @param val The string, copied.
+   */
+  void setString(std::string_view val);
+
+  /**
+   * @brief Get the string value, the entry must be a STR.
+   *
+   * @param scratch Where an int encoded value is formatted.
+   * @return the value, valid until the entry or @p scratch changes.
+   */
+  auto string(std::array<char, MAX_INT_DIGITS> &scratch) const
+      -> std::string_view;
+
+  /**
+   * @brief Get the value as a number, if it is one.
+   *
+   * Only strings that spell an int64 the canonical way are numbers, and those
+   * are always stored as one, so this never parses.
+   *
+   * @param num Set to the number.
+   * @return true if the value is a number.
+   */
+  auto integer(std::int64_t &num) const -> bool {
+    if (encoding != Encoding::INT) {
+      return false;
+    }
+    num = value.num;
+    return true;
+  }
+
+  /**
+   * @brief Replaces the value with a number, whatever it held before.
+   *
+   * @param num The number, stored without a string.
+   */
+  void setInteger(std::int64_t num);
+
+  /**
+   * @brief Replaces the value with an empty zset.
+   *
+   */
+  void setZSet();
+
+  /**
+   * @brief Get the zset value, the entry must be a ZSET.
+   *
+   * @return the zset, owned by the entry.
+   */
+  auto zset() -> ZSet * { return &value.set; }
+  auto zset() const -> const ZSet * { return &value.set; }
+
+  /**
+   * @brief Get the bytes the entry takes, its value included.
+   *
+   * @return the size of every allocation the entry owns.
+   */
+  auto memory() const -> std::size_t;
+
+private:
+  enum class Encoding : std::uint8_t {
+    INLINE = 0,
+    HEAP = 1,
+    INT = 2,
+    ZSET = 3,
+  };
+
+  explicit Entry(std::uint32_t keySize) : keySize(keySize) {}
+  ~Entry() { clearValue(); }
+
+  void clearValue();
+
+  std::uint32_t keySize;
+  Encoding encoding = Encoding::INLINE;
+  std::uint8_t inlineSize = 0;
+  union {
+    char inlined[INLINE_VALUE_SIZE];
+    struct {
+      char *data;
+      std::uint32_t size;
+      std::uint32_t capacity;
+    } heap;
+    std::int64_t num;
+    ZSet set;
+  } value = {};
+};
+
+static_assert(sizeof(Entry) == 40, "the key starts right after the header");
+
+struct EntryHash {
+  auto operator()(const Entry &entry) const -> std::uint64_t {
+    return stringHash(entry.key());
+  }
+  auto operator()(std::string_view key) const -> std::uint64_t {
+    return stringHash(key);
+  }
+};
+
+struct EntryEq {
+  auto operator()(const Entry &entry, std::string_view key) const -> bool {
+    return entry.key() == key;
+  }
 };
 
-auto entryEquality(Node *lhs, Node *rhs) -> bool;
-void scan(const Table &table, const std::function<void(Node *, void *)> &fn,
-          void *arg);
+using EntryMap = IntrusiveHashMap<Entry, &Entry::node, EntryHash, EntryEq>;
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @enum Eviction
+ * @brief Which keys go first when the keyspace is over its memory limit.
+ *
+ */
+enum class Eviction : std::uint8_t {
+  LRU = 0, /** The least recently used */
+  LFU = 1, /** The least frequently used */
+};
+
+/**
+ * Every key keeps ACCESS_BITS of access state. Under LRU it is the access
+ * clock, in LRU_CLOCK_RESOLUTION ticks. Under LFU the high 16 bits are the
+ * minute of the last decay and the low 8 bits a logarithmic access counter,
+ * which starts at LFU_INIT and halves its chance to grow every LFU_LOG_FACTOR
+ * hits, then loses one every LFU_DECAY_MS the key is not used.
+ */
+constexpr std::uint32_t ACCESS_BITS = 24;
+constexpr std::uint32_t ACCESS_MASK = (1U << ACCESS_BITS) - 1;
+constexpr std::uint64_t LRU_CLOCK_RESOLUTION = 100; // ms, wraps in 19 days
+constexpr std::uint32_t LFU_INIT = 5;
+constexpr std::uint32_t LFU_MAX = 255;
+constexpr std::uint32_t LFU_LOG_FACTOR = 10;
+constexpr std::uint64_t LFU_DECAY_MS = 60'000;
+constexpr std::size_t EVICTION_SAMPLES = 5;    // keys sampled per eviction
+constexpr std::size_t EVICTION_POOL_SIZE = 16; // best candidates kept
+
+/**
+ * Approximate LRU and LFU: the access state of a key is updated on every
+ * access, and an eviction samples a few keys and drops the one that ranks
+ * highest of those and of the best candidates of earlier samples, instead of
+ * keeping every key in an exact order.
+ */
+namespace evict {
+
+// the LRU clock, in LRU_CLOCK_RESOLUTION ticks
+inline auto lruClock(std::uint64_t now) -> std::uint32_t {
+  return static_cast<std::uint32_t>(now / LRU_CLOCK_RESOLUTION) & ACCESS_MASK;
+}
+
+// the decay period, which fits the 16 bits above the LFU counter
+inline auto lfuPeriod(std::uint64_t now) -> std::uint32_t {
+  return static_cast<std::uint32_t>(now / LFU_DECAY_MS) & 0xFFFF;
+}
+
+// the counter less one for every period since the key was last used
+inline auto lfuDecayed(std::uint32_t access, std::uint64_t now)
+    -> std::uint32_t {
+  std::uint32_t counter = access & 0xFF;
+  std::uint32_t elapsed = (lfuPeriod(now) - (access >> 8)) & 0xFFFF;
+  return elapsed >= counter ? 0 : counter - elapsed;
+}
+
+/**
+ * @brief Get the access state of a key that was just created.
+ *
+ * @param policy The eviction policy.
+ * @param now The steady clock, in milliseconds.
+ * @return the ACCESS_BITS state.
+ */
+inline auto created(Eviction policy, std::uint64_t now) -> std::uint32_t {
+  return policy == Eviction::LRU ? lruClock(now)
+                                 : lfuPeriod(now) << 8 | LFU_INIT;
+}
+
+/**
+ * @brief Get the access state of a key after it was used.
+ *
+ * @param access The state before.
+ * @param policy The eviction policy.
+ * @param now The steady clock, in milliseconds.
+ * @param random A uniformly random number, for the LFU counter.
+ * @return the new ACCESS_BITS state.
+ */
+inline auto touched(std::uint32_t access, Eviction policy, std::uint64_t now,
+                    std::uint64_t random) -> std::uint32_t {
+  if (policy == Eviction::LRU) {
+    return lruClock(now);
+  }
+
+  // grows with probability 1 / ((counter - LFU_INIT) * LFU_LOG_FACTOR + 1)
+  std::uint32_t counter = lfuDecayed(access, now);
+  if (counter < LFU_MAX) {
+    double base = counter > LFU_INIT ? counter - LFU_INIT : 0;
+    double chance = static_cast<double>(random >> 11) * 0x1p-53;
+    if (chance * (base * LFU_LOG_FACTOR + 1) < 1) {
+      counter++;
+    }
+  }
+  return lfuPeriod(now) << 8 | counter;
+}
+
+/**
+ * @brief Ranks a key for eviction.
+ *
+ * @param access The access state.
+ * @param policy The eviction policy.
+ * @param now The steady clock, in milliseconds.
+ * @return the rank, the key with the highest one is evicted first.
+ */
+inline auto rank(std::uint32_t access, Eviction policy, std::uint64_t now)
+    -> std::uint32_t {
+  if (policy == Eviction::LRU) {
+    return (lruClock(now) - access) & ACCESS_MASK; // ticks since the use
+  }
+  return LFU_MAX - lfuDecayed(access, now);
+}
+
+} // namespace evict
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @class DeadlineHeap
+ * @brief A binary min-heap of objects ordered by deadline.
+ *
+ * Every object keeps its position in the heap in the member `Index`, 1 based
+ * so that 0 means it is not in the heap. Changing or removing the deadline of
+ * any object is O(log n) without a search, and the nearest deadline is O(1).
+ *
+ * The heap only stores pointers, the objects belong to the caller.
+ *
+ * @tparam T The type of the objects.
+ * @tparam Index The position member of T, 0 when the object is not stored.
+ */
+template <typename T, std::uint32_t T::*Index> class DeadlineHeap {
+public:
+  /**
+   * @brief Sets the deadline of @p item, adding it if it is not stored.
+   *
+   * @param item The object.
+   * @param deadline The deadline, any monotonic unit.
+   */
+  void set(T *item, std::uint64_t deadline) {
+    if (!(item->*Index)) {
+      nodes.push_back({deadline, item});
+      item->*Index = static_cast<std::uint32_t>(nodes.size());
+      siftUp(nodes.size() - 1);
+      return;
+    }
+    std::size_t i = item->*Index - 1;
+    auto previous = std::exchange(nodes[i].deadline, deadline);
+    deadline < previous ? siftUp(i) : siftDown(i);
+  }
+
+  /**
+   * @brief Removes @p item, if it is stored.
+   *
+   * @param item The object.
+   */
+  void remove(T *item) {
+    if (!(item->*Index)) {
+      return;
+    }
+    std::size_t i = item->*Index - 1;
+    item->*Index = 0;
+    auto last = nodes.back();
+    nodes.pop_back();
+    if (i < nodes.size()) {
+      nodes[i] = last; // the last node fills the hole
+      last.item->*Index = static_cast<std::uint32_t>(i + 1);
+      siftUp(i);
+      siftDown(static_cast<std::size_t>(last.item->*Index - 1));
+    }
+  }
+
+  /**
+   * @brief Get the deadline of @p item, which must be stored.
+   *
+   * @param item The object.
+   * @return its deadline.
+   */
+  auto deadline(const T *item) const -> std::uint64_t {
+    return nodes[item->*Index - 1].deadline;
+  }
+
+  auto empty() const -> bool { return nodes.empty(); }
+  auto size() const -> std::size_t { return nodes.size(); }
+  auto memory() const -> std::size_t { return nodes.capacity() * sizeof(Node); }
+
+  /** The object with the nearest deadline, the heap must not be empty. */
+  auto top() const -> T * { return nodes.front().item; }
+  auto topDeadline() const -> std::uint64_t { return nodes.front().deadline; }
+
+private:
+  struct Node {
+    std::uint64_t deadline;
+    T *item;
+  };
+
+  void place(std::size_t i, Node node) {
+    nodes[i] = node;
+    node.item->*Index = static_cast<std::uint32_t>(i + 1);
+  }
+
+  void siftUp(std::size_t i) {
+    Node node = nodes[i];
+    while (i > 0) {
+      std::size_t parent = (i - 1) / 2;
+      if (nodes[parent].deadline <= node.deadline) {
+        break;
+      }
+      place(i, nodes[parent]);
+      i = parent;
+    }
+    place(i, node);
+  }
+
+  void siftDown(std::size_t i) {
+    Node node = nodes[i];
+    while (true) {
+      std::size_t child = 2 * i + 1;
+      if (child >= nodes.size()) {
+        break;
+      }
+      if (child + 1 < nodes.size() &&
+          nodes[child + 1].deadline < nodes[child].deadline) {
+        child++;
+      }
+      if (node.deadline <= nodes[child].deadline) {
+        break;
+      }
+      place(i, nodes[child]);
+      i = child;
+    }
+    place(i, node);
+  }
+
+  std::vector<Node> nodes;
+};
@@ -0,0 +1,93 @@
+#include "lazyfree.hxx"
+
+#include <condition_variable>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// how much work freeing the value is, in allocations
+auto effort(const Entry *entry) -> std::size_t {
+  if (entry->type() != KeyType::ZSET || !entry->zset()->tree) {
+    return 1; // a packed set is one buffer
+  }
+  return zset::size(entry->zset());
+}
+
+class Worker {
+public:
+  Worker() : thread([this](std::stop_token stop) { run(stop); }) {}
+
+  Worker(const Worker &) = delete;
+  auto operator=(const Worker &) -> Worker & = delete;
+
+  void push(Entry *entry) {
+    {
+      std::scoped_lock lock(mutex);
+      queue.push_back(entry);
+      pending++;
+    }
+    wake.notify_one();
+  }
+
+  void drain() {
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+  }
+
+  auto stats() -> LazyFreeStats {
+    std::scoped_lock lock(mutex);
+    return {.pending = pending, .freed = freed};
+  }
+
+private:
+  // frees whole batches, what is queued when the thread stops is freed too
+  void run(const std::stop_token &stop) {
+    std::unique_lock lock(mutex);
+    while (wake.wait(lock, stop, [this] { return !queue.empty(); }) ||
+           !queue.empty()) {
+      auto batch = std::exchange(queue, {});
+      lock.unlock();
+      for (auto *entry : batch) {
+        Entry::destroy(entry);
+      }
+      lock.lock();
+      pending -= batch.size();
+      freed += batch.size();
+      done.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable_any wake;
+  std::condition_variable_any done;
+  std::vector<Entry *> queue;
+  std::size_t pending = 0; // queued or being freed
+  std::uint64_t freed = 0;
+  std::jthread thread; // last, it starts running in the constructor
+};
+
+auto worker() -> Worker & {
+  static Worker instance;
+  return instance;
+}
+
+} // namespace
+
+namespace lazyfree {
+
+void destroy(Entry *entry) {
+  if (!entry || effort(entry) <= LAZYFREE_THRESHOLD) {
+    return Entry::destroy(entry);
+  }
+  worker().push(entry);
+}
+
+void drain() { worker().drain(); }
+
+auto stats() -> LazyFreeStats { return worker().stats(); }
+
+} // namespace lazyfree
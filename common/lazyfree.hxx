@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "entry.hxx"
+
+constexpr std::size_t LAZYFREE_THRESHOLD = 64; // zset members freed in place
+
+/**
+ * @struct LazyFreeStats
+ * @brief A snapshot of the background freeing.
+ *
+ */
+struct LazyFreeStats {
+  std::size_t pending = 0; /** Entries handed over and not freed yet */
+  std::uint64_t freed = 0; /** Entries the background thread freed */
+};
+
+/**
+ * Frees large values on a background thread, so deleting a key with millions
+ * of zset members costs the event loop as much as deleting a small one.
+ *
+ * The entry must be out of every keyspace structure when it is handed over,
+ * nothing else may reach it after that. Small values are freed in place, a
+ * round trip through the thread would cost more than the free itself.
+ */
+namespace lazyfree {
+
+/**
+ * @brief Frees @p entry, on the background thread if its value is large.
+ *
+ * @param entry An entry from `Entry::create` that nothing refers to anymore.
+ */
+void destroy(Entry *entry);
+
+/**
+ * @brief Waits until every entry handed over so far is freed.
+ *
+ */
+void drain();
+
+/**
+ * @brief Get the counts of the background freeing.
+ *
+ * @return how many entries are pending and how many were freed.
+ */
+auto stats() -> LazyFreeStats;
+
+} // namespace lazyfree
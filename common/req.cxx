@@ -1,49 +1,236 @@
 #include "req.hxx"
 #include "common/entry.hxx"
+#include "common/lazyfree.hxx"
 #include "common/serialize.hxx"
-#include "map/c/wrap.hxx"
+#include "common/slab.hxx"
+#include "common/snapshot.hxx"
 
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
-#include <memory>
+#include <ctime>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <utility>
-#include <vector>
 
 CommandMap Request::commandMap;
 
-static void keyScan(const Node *node, void *arg) {
-  std::string &output = *static_cast<std::string *>(arg);
-  out::str(output, containerOf(node, Entry, node)->key);
+constexpr auto READ = std::to_underlying(CommandFlag::READ);
+constexpr auto WRITE = std::to_underlying(CommandFlag::WRITE);
+
+constexpr std::size_t PREFETCH_BATCH = 16; // keys looked up together
+constexpr std::int64_t SCAN_DEFAULT_COUNT = 10;
+constexpr std::size_t SCAN_WORK = 10; // home groups visited per key asked for
+
+constexpr Command Request::commands[] = {
+    {"keys", 1, READ, &Request::keys},
+    {"scan", -2, READ, &Request::scan},
+    {"stats", 1, 0, &Request::stats},
+    {"save", 1, 0, &Request::save},
+    {"bgsave", 1, 0, &Request::bgsave},
+    {"get", 2, READ, &Request::get},
+    {"set", 3, WRITE, &Request::set},
+    {"del", 2, WRITE, &Request::del},
+    {"expire", 3, WRITE, &Request::expire},
+    {"pexpire", 3, WRITE, &Request::pexpire},
+    {"pexpireat", 3, WRITE, &Request::pexpireat},
+    {"ttl", 2, READ, &Request::ttl},
+    {"pttl", 2, READ, &Request::pttl},
+    {"persist", 2, WRITE, &Request::persist},
+    {"incr", 2, WRITE, &Request::incr},
+    {"decr", 2, WRITE, &Request::decr},
+    {"incrby", 3, WRITE, &Request::incrby},
+    {"decrby", 3, WRITE, &Request::decrby},
+    {"incrbyfloat", 3, WRITE, &Request::incrbyfloat},
+    {"mget", -2, READ, &Request::mget},
+    {"mset", -3, WRITE, &Request::mset},
+    {"mdel", -2, WRITE, &Request::mdel},
+    {"unlink", -2, WRITE, &Request::mdel}, // deletes free large values lazily
+    {"zadd", 4, WRITE, &Request::zadd},
+    {"zrem", 3, WRITE, &Request::zrem},
+    {"zscore", 3, READ, &Request::zscore},
+    {"zquery", 6, READ, &Request::zquery},
+};
+constexpr std::size_t NUM_COMMANDS = std::size(Request::commands);
+constexpr std::size_t COMMAND_SLOTS = 64; // power of two, > NUM_COMMANDS
+
+static constexpr auto fold(char c) -> char {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static constexpr auto commandHash(std::string_view name, std::uint32_t seed)
+    -> std::size_t {
+  std::uint32_t hash = seed;
+  for (auto c : name) {
+    hash = (hash ^ static_cast<std::uint8_t>(fold(c))) * 0x01000193;
+  }
+  return (hash ^ (hash >> 16)) & (COMMAND_SLOTS - 1);
+}
+
+/**
+ * @brief Maps every hash slot to `1 + index` of its command, 0 if empty.
+ *
+ * @param seed The hash seed.
+ * @return the slots, or an empty array if two commands collide.
+ */
+static constexpr auto commandSlots(std::uint32_t seed)
+    -> std::array<std::uint8_t, COMMAND_SLOTS> {
+  std::array<std::uint8_t, COMMAND_SLOTS> slots = {};
+  for (std::size_t i = 0; i < NUM_COMMANDS; ++i) {
+    auto &slot = slots[commandHash(Request::commands[i].name, seed)];
+    if (slot) {
+      return {};
+    }
+    slot = static_cast<std::uint8_t>(i + 1);
+  }
+  return slots;
+}
+
+// the first seed that makes the hash perfect for the table
+static constexpr auto perfectSeed() -> std::uint32_t {
+  std::uint32_t seed = 0x811C9DC5;
+  auto first = [](std::uint32_t seed) {
+    return commandHash(Request::commands[0].name, seed);
+  };
+  while (!commandSlots(seed)[first(seed)]) {
+    seed++;
+  }
+  return seed;
+}
+
+constexpr std::uint32_t COMMAND_SEED = perfectSeed();
+constexpr auto COMMAND_INDEX = commandSlots(COMMAND_SEED);
+
+// per command call counts, guarded by the keyspace mutex
+static std::array<std::uint64_t, NUM_COMMANDS> commandCalls = {};
+static std::uint32_t callsSinceExpiry = 0;
+static std::uint64_t expiredKeys = 0;
+static std::uint64_t evictedKeys = 0;
+static std::size_t keyBytes = 0; // every `Entry::memory()` summed up
+static std::size_t maxMemory = 0;
+static Eviction evictionPolicy = Eviction::LRU;
+static bool replaying = false; // the log has the evictions and expiries
+
+// the snapshot file, and how saving it went
+static std::string snapshotPath;
+static pid_t saveChild = 0;  // the BGSAVE child, 0 if none
+static int saveReport = -1;  // the pipe the child sends its SaveReport on
+static bool lastSaveOk = true;
+static std::int64_t lastSaveTime = 0; // unix seconds of the last good save
+static std::uint64_t lastSaveUs = 0;
+static std::uint64_t lastForkUs = 0;
+static std::uint64_t lastCowBytes = 0;
+
+/**
+ * @struct SaveReport
+ * @brief What a BGSAVE child tells the server before it exits.
+ *
+ */
+struct SaveReport {
+  std::uint64_t saveUs;   /** How long writing the snapshot took */
+  std::uint64_t cowBytes; /** The memory copied on write since the fork */
+};
+
+static auto nowMs() -> std::uint64_t {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+// the clock of the access state of keys, coarse but much cheaper to read
+static auto coarseMs() -> std::uint64_t {
+  timespec now{};
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return static_cast<std::uint64_t>(now.tv_sec) * 1000 +
+         static_cast<std::uint64_t>(now.tv_nsec) / 1'000'000;
+}
+
+static auto wallMs() -> std::int64_t {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+static auto microsSince(std::chrono::steady_clock::time_point start)
+    -> std::uint64_t {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+}
+
+// the pages of this process no longer shared with its parent, in bytes
+static auto privateDirtyBytes() -> std::uint64_t {
+  int fd = ::open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  std::array<char, 4096> text{};
+  auto n = ::read(fd, text.data(), text.size() - 1);
+  ::close(fd);
+  const char *field =
+      n > 0 ? std::strstr(text.data(), "Private_Dirty:") : nullptr;
+  if (!field) {
+    return 0;
+  }
+  return std::strtoull(field + std::strlen("Private_Dirty:"), nullptr, 10) *
+         1024;
+}
+
+// splitmix64, for sampling keys and growing LFU counters
+static auto nextRandom() -> std::uint64_t {
+  static std::uint64_t state = 0;
+  std::uint64_t z = (state += 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+// runs `change` on the value of `entry` and accounts for the bytes it takes
+template <typename Fn> static void resize(Entry *entry, Fn &&change) {
+  auto before = entry->memory();
+  change();
+  keyBytes += entry->memory() - before;
 }
 
-static auto strToDouble(const std::string &s, std::double_t &output) {
+// the views are not null terminated, numbers fit in the small string buffer
+static auto strToDouble(std::string_view view, std::double_t &output) {
+  std::string s(view);
   char *endPtr = nullptr;
   output = strtod(s.c_str(), &endPtr);
-  return endPtr == s.c_str() + s.size() && !std::isnan(output);
+  return !s.empty() && endPtr == s.c_str() + s.size() && !std::isnan(output);
 }
 
-static auto strToInt(const std::string &s, std::int64_t &output) {
+static auto strToInt(std::string_view view, std::int64_t &output) {
+  std::string s(view);
   char *endPtr = nullptr;
-  output = strtol(s.c_str(), &endPtr, 10);
-  return endPtr == s.c_str() + s.size();
+  errno = 0;
+  output = strtoll(s.c_str(), &endPtr, 10);
+  return !s.empty() && errno != ERANGE && endPtr == s.c_str() + s.size();
 }
 
-auto Request::expectZSet(std::string &output, std::string &s,
+auto Request::expectZSet(Output &output, std::string_view s,
                          Entry **entry) const {
-  Entry key;
-  key.key.swap(s);
-  key.node.code = stringHash(key.key);
+  *entry = findKey(s, stringHash(s));
 
-  const auto *node = map::lookup(&commandMap.db, &key.node, &entryEquality);
-
-  if (!node) {
+  if (!*entry) {
     out::nil(output);
     return false;
   }
 
-  *entry = containerOf(node, Entry, node);
-  if ((*entry)->type != std::to_underlying(KeyType::ZSET)) {
+  if ((*entry)->type() != KeyType::ZSET) {
     out::err(output, std::to_underlying(Error::TYPE), "expect zset");
     return false;
   }
@@ -51,75 +238,68 @@ auto Request::expectZSet(std::string &output, std::string &s,
   return true;
 }
 
-void Request::zadd(std::vector<std::string> &commandList,
-                   std::string &output) const {
+void Request::zadd(const Arguments &commandList, Output &output) const {
   std::double_t score = 0;
   if (!strToDouble(commandList[2], score)) {
     return out::err(output, std::to_underlying(Error::ARG), "expect fp number");
   }
 
-  Entry key;
-  key.key.swap(commandList[1]);
-  key.node.code = stringHash(key.key);
-
-  const auto *node = map::lookup(&commandMap.db, &key.node, &entryEquality);
-  Entry *entry = nullptr;
+  auto key = commandList[1];
+  auto code = stringHash(key);
+  auto *entry = findKey(key, code);
 
-  if (!node) {
-    entry = new Entry();
-    entry->key.swap(key.key);
-    entry->node.code = key.node.code;
-    entry->type = std::to_underlying(KeyType::ZSET);
-    entry->set = std::make_unique<ZSet>();
-    map::insert(&commandMap.db, &entry->node);
+  if (!entry) {
+    entry = addKey(key, code);
+    resize(entry, [entry] { entry->setZSet(); });
   } else {
-    entry = containerOf(node, Entry, node);
-    if (entry->type != std::to_underlying(KeyType::ZSET)) {
+    if (entry->type() != KeyType::ZSET) {
       return out::err(output, std::to_underlying(Error::TYPE), "expect zset");
     }
   }
 
   // add or update the tuple
-  const auto &name = commandList[3];
-  auto added = zset::add(entry->set.get(), name.data(), name.size(), score);
+  auto name = commandList[3];
+  bool added = false;
+  resize(entry, [&] {
+    added = zset::add(entry->zset(), name, name.size(), score);
+  });
   return out::num(output, static_cast<std::int64_t>(added));
 }
 
-void Request::zrem(std::vector<std::string> &commandList,
-                   std::string &output) const {
+void Request::zrem(const Arguments &commandList, Output &output) const {
   Entry *entry = nullptr;
   if (!expectZSet(output, commandList[1], &entry)) {
     return;
   }
 
-  const auto &name = commandList[2];
-  auto *node = zset::pop(entry->set.get(), name.data(), name.size());
-  if (node)
-    zset::del(node);
-  return out::num(output, node ? 1 : 0);
+  auto name = commandList[2];
+  bool removed = false;
+  resize(entry,
+         [&] { removed = zset::remove(entry->zset(), name, name.size()); });
+  return out::num(output, removed ? 1 : 0);
 }
 
-void Request::zscore(std::vector<std::string> &commandList,
-                     std::string &output) const {
+void Request::zscore(const Arguments &commandList, Output &output) const {
 
   Entry *entry = nullptr;
   if (!expectZSet(output, commandList[1], &entry)) {
     return;
   }
 
-  const auto &name = commandList[2];
-  const auto *node = zset::lookup(entry->set.get(), name.data(), name.size());
-  return node ? out::dbl(output, node->score) : out::nil(output);
+  auto name = commandList[2];
+  std::double_t score = 0;
+  return zset::lookup(entry->zset(), name, name.size(), score)
+             ? out::dbl(output, score)
+             : out::nil(output);
 }
 
-void Request::zquery(std::vector<std::string> &commandList,
-                     std::string &output) const {
+void Request::zquery(const Arguments &commandList, Output &output) const {
   std::double_t score = 0;
   if (!strToDouble(commandList[2], score)) {
     return out::err(output, std::to_underlying(Error::ARG), "expect fp number");
   }
 
-  const auto &name = commandList[3];
+  auto name = commandList[3];
   std::int64_t off = 0;
   std::int64_t limit = 0;
 
@@ -144,88 +324,844 @@ void Request::zquery(std::vector<std::string> &commandList,
   if (limit <= 0) {
     return out::arr(output, 0);
   }
-  auto *node = zset::query(entry->set.get(), score, name.data(), name.size());
-  node = zset::offset(node, off);
+  auto cursor = zset::query(entry->zset(), score, name, name.size());
+  cursor = zset::offset(cursor, off);
 
   // output
   auto arr = out::begin_arr(output);
   std::uint32_t n = 0;
-  while (node && static_cast<std::int64_t>(n) < limit) {
-    out::str(output, node->name);
-    out::dbl(output, node->score);
-    node = zset::offset(node, +1);
+  while (cursor && static_cast<std::int64_t>(n) < limit) {
+    auto member = zset::member(cursor);
+    out::str(output, member.name);
+    out::dbl(output, member.score);
+    cursor = zset::offset(cursor, +1);
     n += 2;
   }
 
   out::end_arr(output, arr, n);
 }
 
-auto Request::isCommand(const std::string &word,
-                        const char *commandList) const {
-  return 0 == strcasecmp(word.c_str(), commandList);
+void Request::keys([[maybe_unused]] const Arguments &commandList,
+                   Output &output) const {
+  auto now = nowMs();
+  auto arr = out::begin_arr(output);
+  std::uint32_t n = 0;
+  commandMap.db.forEach([&](const Entry &entry) {
+    if (!expired(&entry, now)) {
+      out::str(output, entry.key());
+      n++;
+    }
+  });
+  out::end_arr(output, arr, n);
 }
 
-void Request::keys([[maybe_unused]] std::vector<std::string> &commandList,
-                   std::string &output) const {
-  out::arr(output, static_cast<std::uint32_t>(map::size(&commandMap.db)));
-  scan(commandMap.db.table1, &keyScan, &output);
-  scan(commandMap.db.table2, &keyScan, &output);
+static auto equalsFolded(std::string_view lhs, std::string_view rhs) -> bool {
+  return std::ranges::equal(lhs, rhs, {}, fold, fold);
 }
 
-void Request::get(std::vector<std::string> &commandList,
-                  std::string &output) const {
-  Entry key;
-  key.key.swap(commandList[1]);
-  key.node.code = stringHash(key.key);
+// matches the pattern element at `i` against `c` and moves `next` past it
+static auto globChar(std::string_view pattern, std::size_t i, char c,
+                     std::size_t &next) -> bool {
+  next = i + 1;
+  if (pattern[i] == '?') {
+    return true;
+  }
+  if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+    next = i + 2;
+    return pattern[i + 1] == c;
+  }
+  if (pattern[i] != '[') {
+    return pattern[i] == c;
+  }
 
-  const auto *node = map::lookup(&commandMap.db, &key.node, &entryEquality);
+  std::size_t j = i + 1;
+  bool negate = j < pattern.size() && pattern[j] == '^';
+  j += negate;
+  bool found = false;
+  for (bool first = true; j < pattern.size() && (first || pattern[j] != ']');
+       first = false) {
+    if (pattern[j] == '\\' && j + 1 < pattern.size()) {
+      found |= pattern[j + 1] == c;
+      j += 2;
+    } else if (j + 2 < pattern.size() && pattern[j + 1] == '-' &&
+               pattern[j + 2] != ']') {
+      found |= pattern[j] <= c && c <= pattern[j + 2];
+      j += 3;
+    } else {
+      found |= pattern[j] == c;
+      j++;
+    }
+  }
+  if (j >= pattern.size()) {
+    return c == '['; // never closed, a plain '['
+  }
+  next = j + 1;
+  return found != negate;
+}
 
-  if (!node) {
+/**
+ * @brief Matches @p s against a glob pattern: `*`, `?`, `[a-z]`, `[^abc]` and
+ * `\` to escape.
+ *
+ * @param pattern The pattern.
+ * @param s The string.
+ * @return true if the whole string matches.
+ */
+static auto globMatch(std::string_view pattern, std::string_view s) -> bool {
+  std::size_t p = 0;
+  std::size_t i = 0;
+  std::size_t starP = std::string_view::npos; // where to retry after a '*'
+  std::size_t starI = 0;
+  while (i < s.size()) {
+    std::size_t next = 0;
+    if (p < pattern.size() && pattern[p] == '*') {
+      starP = ++p;
+      starI = i;
+    } else if (p < pattern.size() && globChar(pattern, p, s[i], next)) {
+      p = next;
+      i++;
+    } else if (starP != std::string_view::npos) {
+      p = starP; // let the '*' take one more character
+      i = ++starI;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+  return p == pattern.size();
+}
+
+void Request::scan(const Arguments &commandList, Output &output) const {
+  std::int64_t cursor = 0;
+  if (!strToInt(commandList[1], cursor) || cursor < 0) {
+    return out::err(output, std::to_underlying(Error::ARG), "invalid cursor");
+  }
+
+  std::string_view pattern = "*";
+  std::int64_t count = SCAN_DEFAULT_COUNT;
+  for (std::size_t i = 2; i < commandList.size(); i += 2) {
+    auto option = commandList[i];
+    if (i + 1 == commandList.size()) {
+      return out::err(output, std::to_underlying(Error::ARG), "syntax error");
+    }
+    if (equalsFolded(option, "match")) {
+      pattern = commandList[i + 1];
+    } else if (equalsFolded(option, "count")) {
+      if (!strToInt(commandList[i + 1], count) || count <= 0) {
+        return out::err(output, std::to_underlying(Error::ARG),
+                        "expect positive int");
+      }
+    } else {
+      return out::err(output, std::to_underlying(Error::ARG), "syntax error");
+    }
+  }
+
+  // visit home groups until there are `count` keys, or 10x that many groups
+  // went by without enough matches, so one call never walks the whole map
+  std::vector<std::string_view> keys;
+  auto now = nowMs();
+  auto next = static_cast<std::size_t>(cursor);
+  auto limit = static_cast<std::size_t>(count);
+  std::size_t groups = 0;
+  do {
+    next = commandMap.db.scan(next, [&](const Entry &entry) {
+      if (!expired(&entry, now) && globMatch(pattern, entry.key())) {
+        keys.push_back(entry.key());
+      }
+    });
+  } while (next && keys.size() < limit && ++groups < limit * SCAN_WORK);
+
+  out::arr(output, 2);
+  out::num(output, static_cast<std::int64_t>(next));
+  out::arr(output, static_cast<std::uint32_t>(keys.size()));
+  for (auto key : keys) {
+    out::str(output, key);
+  }
+}
+
+void Request::stats([[maybe_unused]] const Arguments &commandList,
+                    Output &output) const {
+  auto pool = ChunkPool::shared.stats();
+  std::int64_t usedBytes = 0;
+  std::int64_t freeBytes = 0;
+
+  auto arr = out::begin_arr(output);
+  std::uint32_t n = 0;
+  for (std::size_t i = 0; i < CHUNK_SIZES.size(); ++i) {
+    auto size = std::to_string(CHUNK_SIZES[i]);
+    out::str(output, "pool_used_chunks_" + size);
+    out::num(output, static_cast<std::int64_t>(pool.used[i]));
+    out::str(output, "pool_free_chunks_" + size);
+    out::num(output, static_cast<std::int64_t>(pool.free[i]));
+    usedBytes += static_cast<std::int64_t>(pool.used[i] * CHUNK_SIZES[i]);
+    freeBytes += static_cast<std::int64_t>(pool.free[i] * CHUNK_SIZES[i]);
+    n += 4;
+  }
+  out::str(output, "pool_used_bytes");
+  out::num(output, usedBytes);
+  out::str(output, "pool_free_bytes");
+  out::num(output, freeBytes);
+  n += 4;
+
+  auto slabs = slab::stats();
+  auto sum = [](const auto &counts) {
+    return static_cast<std::int64_t>(
+        std::accumulate(counts.begin(), counts.end(), std::size_t{0}));
+  };
+  out::str(output, "slab_live_objects");
+  out::num(output, sum(slabs.live));
+  out::str(output, "slab_free_objects");
+  out::num(output, sum(slabs.free));
+  out::str(output, "slab_pages");
+  out::num(output, sum(slabs.pages));
+  n += 6;
+
+  out::str(output, "keys");
+  out::num(output, static_cast<std::int64_t>(commandMap.db.size()));
+  out::str(output, "keys_with_ttl");
+  out::num(output, static_cast<std::int64_t>(commandMap.ttl.size()));
+  out::str(output, "expired_keys");
+  out::num(output, static_cast<std::int64_t>(expiredKeys));
+  n += 6;
+
+  out::str(output, "used_memory");
+  out::num(output, static_cast<std::int64_t>(usedMemory()));
+  out::str(output, "maxmemory");
+  out::num(output, static_cast<std::int64_t>(maxMemory));
+  out::str(output, "evicted_keys");
+  out::num(output, static_cast<std::int64_t>(evictedKeys));
+  n += 6;
+
+  auto lazy = lazyfree::stats();
+  reapSave();
+  out::str(output, "bgsave_in_progress");
+  out::num(output, saveChild ? 1 : 0);
+  out::str(output, "last_save_ok");
+  out::num(output, lastSaveOk ? 1 : 0);
+  out::str(output, "last_save_time");
+  out::num(output, lastSaveTime);
+  out::str(output, "last_save_usec");
+  out::num(output, static_cast<std::int64_t>(lastSaveUs));
+  out::str(output, "latest_fork_usec");
+  out::num(output, static_cast<std::int64_t>(lastForkUs));
+  out::str(output, "last_cow_bytes");
+  out::num(output, static_cast<std::int64_t>(lastCowBytes));
+  n += 12;
+
+  auto log = aof::stats();
+  out::str(output, "aof_enabled");
+  out::num(output, aof::enabled() ? 1 : 0);
+  out::str(output, "aof_written_bytes");
+  out::num(output, static_cast<std::int64_t>(log.writtenBytes));
+  out::str(output, "aof_writes");
+  out::num(output, static_cast<std::int64_t>(log.writes));
+  out::str(output, "aof_fsyncs");
+  out::num(output, static_cast<std::int64_t>(log.fsyncs));
+  out::str(output, "aof_errors");
+  out::num(output, static_cast<std::int64_t>(log.errors));
+  n += 10;
+
+  out::str(output, "lazyfree_pending_objects");
+  out::num(output, static_cast<std::int64_t>(lazy.pending));
+  out::str(output, "lazyfreed_objects");
+  out::num(output, static_cast<std::int64_t>(lazy.freed));
+  n += 4;
+
+  for (std::size_t i = 0; i < NUM_COMMANDS; ++i) {
+    out::str(output, "calls_" + std::string(commands[i].name));
+    out::num(output, static_cast<std::int64_t>(commandCalls[i]));
+    n += 2;
+  }
+
+  out::end_arr(output, arr, n);
+}
+
+void Request::get(const Arguments &commandList, Output &output) const {
+  const auto *entry = findKey(commandList[1], stringHash(commandList[1]));
+
+  if (!entry) {
     return out::nil(output);
   }
 
-  const auto &value = containerOf(node, Entry, node)->val;
-  out::str(output, value);
+  if (entry->type() != KeyType::STR) {
+    return out::err(output, std::to_underlying(Error::TYPE), "expect string");
+  }
+
+  std::array<char, MAX_INT_DIGITS> scratch{};
+  out::str(output, entry->string(scratch));
+}
+
+void Request::set(const Arguments &commandList, Output &output) const {
+  auto key = commandList[1];
+  auto code = stringHash(key);
+  auto *entry = replaceKey(key, code);
+  resize(entry, [&] { entry->setString(commandList[2]); });
+
+  return out::nil(output);
+}
+
+void Request::del(const Arguments &commandList, Output &output) const {
+  // a key past its deadline expires first, and counts as such
+  auto *entry = findKey(commandList[1], stringHash(commandList[1]));
+  if (entry) {
+    dropKey(entry);
+  }
+
+  return out::num(output, entry ? 1 : 0);
+}
+
+auto Request::findKey(std::string_view key, std::uint64_t code) -> Entry * {
+  auto *entry = commandMap.db.find(key, code);
+  if (!entry) {
+    return nullptr;
+  }
+  // lazy expiry, nobody sees the key after its deadline. A replay keeps it,
+  // the commands after it in the log ran before the deadline
+  if (!replaying && expired(entry, nowMs())) {
+    expireKey(entry);
+    return nullptr;
+  }
+  touch(entry);
+  return entry;
+}
+
+auto Request::addKey(std::string_view key, std::uint64_t code) -> Entry * {
+  auto *entry = Entry::create(key);
+  entry->access = evict::created(evictionPolicy, coarseMs());
+  commandMap.db.insert(entry, code);
+  keyBytes += entry->memory();
+  return entry;
+}
+
+// the key, ready for a new string value without an expiry
+auto Request::replaceKey(std::string_view key, std::uint64_t code) -> Entry * {
+  auto *entry = commandMap.db.find(key, code);
+  if (entry && entry->type() == KeyType::ZSET) {
+    dropKey(entry); // the zset may be large, leave it to freeKey
+    entry = nullptr;
+  }
+  if (!entry) {
+    return addKey(key, code);
+  }
+  commandMap.ttl.remove(entry);
+  touch(entry);
+  return entry;
+}
+
+void Request::touch(Entry *entry) {
+  auto random = evictionPolicy == Eviction::LFU ? nextRandom() : 0;
+  entry->access =
+      evict::touched(entry->access, evictionPolicy, coarseMs(), random);
+}
+
+auto Request::expired(const Entry *entry, std::uint64_t now) -> bool {
+  return entry->heapIndex && commandMap.ttl.deadline(entry) <= now;
+}
+
+// drops a key past its deadline, the log gets a DEL so a replay drops it too
+void Request::expireKey(Entry *entry) {
+  if (aof::enabled()) {
+    std::array<std::string_view, 2> args = {"del", entry->key()};
+    aof::append(args);
+  }
+  dropKey(entry);
+  expiredKeys++;
+}
+
+void Request::dropKey(Entry *entry) {
+  commandMap.db.pop(entry->key(), entry->node.code);
+  freeKey(entry);
+}
+
+// frees a key that is no longer in the keyspace, large values in the
+// background
+void Request::freeKey(Entry *entry) {
+  commandMap.ttl.remove(entry);
+  keyBytes -= entry->memory();
+  lazyfree::destroy(entry);
+}
+
+/**
+ * @brief Deletes keys whose deadline passed, nearest deadline first.
+ *
+ * Logs a DEL for each. During a replay nothing expires, the log already has
+ * the DEL of every key that did.
+ *
+ * @param budget The most keys to delete.
+ * @return true if more keys are due.
+ */
+auto Request::expireDue(std::size_t budget) -> bool {
+  if (replaying) {
+    return false;
+  }
+  auto &deadlines = commandMap.ttl;
+  auto now = nowMs();
+  for (; budget > 0 && !deadlines.empty() && deadlines.topDeadline() <= now;
+       --budget) {
+    expireKey(deadlines.top());
+  }
+  return !deadlines.empty() && deadlines.topDeadline() <= now;
+}
+
+auto Request::usedMemory() -> std::size_t {
+  return keyBytes + commandMap.db.memory() + commandMap.ttl.memory();
+}
+
+/**
+ * @struct Candidate
+ * @brief A key sampled for eviction, kept by name as it may go away.
+ *
+ */
+struct Candidate {
+  std::uint32_t rank;
+  std::uint64_t code;
+  std::string key;
+};
+
+// the best candidates of the samples so far, by ascending rank
+static std::vector<Candidate> evictionPool;
+
+static void offer(const Entry &entry, std::uint32_t rank) {
+  auto &pool = evictionPool;
+  if (pool.size() == EVICTION_POOL_SIZE && rank <= pool.front().rank) {
+    return;
+  }
+  if (std::ranges::any_of(pool, [&entry](const Candidate &candidate) {
+        return candidate.key == entry.key();
+      })) {
+    return;
+  }
+  if (pool.size() == EVICTION_POOL_SIZE) {
+    pool.erase(pool.begin());
+  }
+  auto at = std::ranges::upper_bound(pool, rank, {}, &Candidate::rank);
+  pool.insert(at, {rank, entry.node.code, std::string(entry.key())});
+}
+
+/**
+ * @brief Evicts keys while the keyspace is over its memory limit.
+ *
+ * Every eviction offers EVICTION_SAMPLES random keys to the pool of the best
+ * candidates and drops the one the policy ranks highest, unless it was used
+ * or deleted since it was sampled. The victims go into the append-only log as
+ * DEL, and a replay of the log evicts nothing on its own.
+ *
+ * @param budget The most keys to evict.
+ * @return true if the keyspace is still over the limit.
+ */
+auto Request::evictToLimit(std::size_t budget) -> bool {
+  auto over = [] {
+    return maxMemory && usedMemory() > maxMemory && commandMap.db.size();
+  };
+  if (replaying) {
+    return false; // a sample would pick other victims than the logged ones
+  }
+  for (; budget > 0 && over(); --budget) {
+    auto now = coarseMs();
+    Entry *victim = nullptr;
+    while (!victim) {
+      commandMap.db.sample(nextRandom(), EVICTION_SAMPLES, [&](Entry &entry) {
+        offer(entry, evict::rank(entry.access, evictionPolicy, now));
+      });
+      while (!victim && !evictionPool.empty()) {
+        auto candidate = std::move(evictionPool.back());
+        evictionPool.pop_back();
+        auto *entry = commandMap.db.find(candidate.key, candidate.code);
+        if (entry &&
+            evict::rank(entry->access, evictionPolicy, now) >= candidate.rank) {
+          victim = entry;
+        }
+      }
+    }
+    if (aof::enabled()) { // a replay has to drop the same key
+      std::array<std::string_view, 2> args = {"del", victim->key()};
+      aof::append(args);
+    }
+    dropKey(victim);
+    evictedKeys++;
+  }
+  return over();
+}
+
+void Request::expireAfter(const Arguments &commandList, Output &output,
+                          std::int64_t unit) const {
+  std::int64_t after = 0;
+  if (!strToInt(commandList[2], after) ||
+      after > std::numeric_limits<std::int64_t>::max() / unit / 2) {
+    return out::err(output, std::to_underlying(Error::ARG),
+                    "invalid expire time");
+  }
+
+  auto *entry = findKey(commandList[1], stringHash(commandList[1]));
+  if (!entry) {
+    return out::num(output, 0);
+  }
+
+  if (after <= 0) {
+    dropKey(entry); // already past its deadline
+  } else {
+    commandMap.ttl.set(entry, nowMs() + static_cast<std::uint64_t>(after) *
+                                            static_cast<std::uint64_t>(unit));
+  }
+  return out::num(output, 1);
+}
+
+void Request::expire(const Arguments &commandList, Output &output) const {
+  expireAfter(commandList, output, 1000);
+}
+
+void Request::pexpire(const Arguments &commandList, Output &output) const {
+  expireAfter(commandList, output, 1);
 }
 
-void Request::set(std::vector<std::string> &commandList,
-                  std::string &output) const {
-  Entry key;
-  key.key.swap(commandList[1]);
-  key.node.code = stringHash(key.key);
+// sets the deadline as a unix time in milliseconds, what the log keeps
+void Request::pexpireat(const Arguments &commandList, Output &output) const {
+  std::int64_t at = 0;
+  if (!strToInt(commandList[2], at)) {
+    return out::err(output, std::to_underlying(Error::ARG),
+                    "invalid expire time");
+  }
 
-  const auto *node = map::lookup(&commandMap.db, &key.node, &entryEquality);
+  auto *entry = findKey(commandList[1], stringHash(commandList[1]));
+  if (!entry) {
+    return out::num(output, 0);
+  }
 
-  if (node) {
-    containerOf(node, Entry, node)->val.swap(commandList[2]);
+  auto wall = wallMs();
+  if (at > wall) {
+    commandMap.ttl.set(entry, nowMs() + static_cast<std::uint64_t>(at - wall));
+  } else if (replaying) {
+    // due already, but the commands after it in the log still see the key
+    commandMap.ttl.set(entry, nowMs());
   } else {
-    auto entry = new Entry();
-    entry->key.swap(key.key);
-    entry->node.code = key.node.code;
-    entry->val.swap(commandList[2]);
-    map::insert(&commandMap.db, &entry->node);
+    dropKey(entry);
+  }
+  return out::num(output, 1);
+}
+
+void Request::timeToLive(const Arguments &commandList, Output &output,
+                         std::int64_t unit) const {
+  const auto *entry = findKey(commandList[1], stringHash(commandList[1]));
+  if (!entry) {
+    return out::num(output, -2);
+  }
+  if (!entry->heapIndex) {
+    return out::num(output, -1);
   }
 
+  auto deadline = commandMap.ttl.deadline(entry);
+  auto now = nowMs();
+  auto left = static_cast<std::int64_t>(deadline > now ? deadline - now : 0);
+  return out::num(output, (left + unit / 2) / unit);
+}
+
+void Request::ttl(const Arguments &commandList, Output &output) const {
+  timeToLive(commandList, output, 1000);
+}
+
+void Request::pttl(const Arguments &commandList, Output &output) const {
+  timeToLive(commandList, output, 1);
+}
+
+void Request::persist(const Arguments &commandList, Output &output) const {
+  auto *entry = findKey(commandList[1], stringHash(commandList[1]));
+  if (!entry || !entry->heapIndex) {
+    return out::num(output, 0);
+  }
+  commandMap.ttl.remove(entry);
+  return out::num(output, 1);
+}
+
+/**
+ * @brief Adds to the number stored at a key, which starts at 0 if missing.
+ *
+ * The key keeps its expiry. The amount is the third argument, or 1.
+ *
+ * @param commandList The arguments.
+ * @param output Where the new number is written.
+ * @param sign 1 to add the amount, -1 to subtract it.
+ */
+void Request::incrementBy(const Arguments &commandList, Output &output,
+                          std::int64_t sign) const {
+  std::int64_t delta = 1;
+  if (commandList.size() == 3 && !strToInt(commandList[2], delta)) {
+    return out::err(output, std::to_underlying(Error::ARG), "expect int");
+  }
+  if (sign < 0 && delta == std::numeric_limits<std::int64_t>::min()) {
+    return out::err(output, std::to_underlying(Error::ARG), "overflow");
+  }
+  delta *= sign;
+
+  auto key = commandList[1];
+  auto code = stringHash(key);
+  auto *entry = findKey(key, code);
+  std::int64_t num = 0;
+  if (entry && entry->type() != KeyType::STR) {
+    return out::err(output, std::to_underlying(Error::TYPE), "expect string");
+  }
+  if (entry && !entry->integer(num)) {
+    return out::err(output, std::to_underlying(Error::ARG), "expect int value");
+  }
+  if (__builtin_add_overflow(num, delta, &num)) {
+    return out::err(output, std::to_underlying(Error::ARG), "overflow");
+  }
+
+  if (!entry) {
+    entry = addKey(key, code);
+  }
+  entry->setInteger(num); // stored inline, the entry keeps its size
+  return out::num(output, num);
+}
+
+void Request::incr(const Arguments &commandList, Output &output) const {
+  incrementBy(commandList, output, 1);
+}
+
+void Request::decr(const Arguments &commandList, Output &output) const {
+  incrementBy(commandList, output, -1);
+}
+
+void Request::incrby(const Arguments &commandList, Output &output) const {
+  incrementBy(commandList, output, 1);
+}
+
+void Request::decrby(const Arguments &commandList, Output &output) const {
+  incrementBy(commandList, output, -1);
+}
+
+void Request::incrbyfloat(const Arguments &commandList, Output &output) const {
+  std::double_t delta = 0;
+  if (!strToDouble(commandList[2], delta)) {
+    return out::err(output, std::to_underlying(Error::ARG), "expect fp number");
+  }
+
+  auto key = commandList[1];
+  auto code = stringHash(key);
+  auto *entry = findKey(key, code);
+  std::double_t num = 0;
+  if (entry && entry->type() != KeyType::STR) {
+    return out::err(output, std::to_underlying(Error::TYPE), "expect string");
+  }
+  std::array<char, MAX_INT_DIGITS> scratch{};
+  if (entry && !strToDouble(entry->string(scratch), num)) {
+    return out::err(output, std::to_underlying(Error::ARG),
+                    "expect fp number value");
+  }
+  num += delta;
+  if (!std::isfinite(num)) {
+    return out::err(output, std::to_underlying(Error::ARG), "overflow");
+  }
+
+  // the shortest text that reads back as the same double, "3" for 3.0
+  std::array<char, 32> text{};
+  auto [last, _] = std::to_chars(text.begin(), text.end(), num);
+  if (!entry) {
+    entry = addKey(key, code);
+  }
+  resize(entry, [&] { entry->setString({text.data(), last}); });
+  return out::dbl(output, num);
+}
+
+/**
+ * @brief Writes every key to the snapshot file, expired ones included.
+ *
+ * Deadlines are stored as wall clock time, so they survive a restart.
+ *
+ * @return false if the file could not be written.
+ */
+auto Request::saveSnapshot() -> bool {
+  auto now = static_cast<std::int64_t>(nowMs());
+  auto wall = wallMs();
+  return snapshot::save(
+      snapshotPath, commandMap.db.size(), [&](SnapshotWriter &writer) {
+        commandMap.db.forEach([&](const Entry &entry) {
+          std::int64_t expireAt = 0;
+          if (entry.heapIndex) {
+            auto deadline =
+                static_cast<std::int64_t>(commandMap.ttl.deadline(&entry));
+            expireAt = std::max<std::int64_t>(wall + deadline - now, 1);
+          }
+          writer.add(entry, expireAt);
+        });
+      });
+}
+
+// collects the BGSAVE child once it exits
+void Request::reapSave() {
+  if (!saveChild) {
+    return;
+  }
+  int status = 0;
+  auto pid = waitpid(saveChild, &status, WNOHANG);
+  if (pid == 0) {
+    return; // still writing
+  }
+
+  SaveReport report{};
+  if (::read(saveReport, &report, sizeof(report)) == sizeof(report)) {
+    lastSaveUs = report.saveUs;
+    lastCowBytes = report.cowBytes;
+  }
+  ::close(saveReport);
+  lastSaveOk = pid == saveChild && WIFEXITED(status) && !WEXITSTATUS(status);
+  if (lastSaveOk) {
+    lastSaveTime = wallMs() / 1000;
+  }
+  saveChild = 0;
+  saveReport = -1;
+}
+
+void Request::save([[maybe_unused]] const Arguments &commandList,
+                   Output &output) const {
+  reapSave();
+  if (snapshotPath.empty()) {
+    return out::err(output, std::to_underlying(Error::UNKNOWN),
+                    "no snapshot file");
+  }
+  if (saveChild) {
+    return out::err(output, std::to_underlying(Error::UNKNOWN),
+                    "background save in progress");
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  lastSaveOk = saveSnapshot();
+  if (!lastSaveOk) {
+    return out::err(output, std::to_underlying(Error::UNKNOWN), "save failed");
+  }
+  lastSaveUs = microsSince(start);
+  lastSaveTime = wallMs() / 1000;
   return out::nil(output);
 }
 
-void Request::del(std::vector<std::string> &commandList,
-                  std::string &output) const {
-  Entry key;
-  key.key.swap(commandList[1]);
-  key.node.code = stringHash(key.key);
+/**
+ * @brief Saves the snapshot from a forked child, while the server goes on.
+ *
+ * The child sees the keyspace as it was at the fork, the kernel copies a page
+ * only when the server writes to it. The child writes the file, reports how
+ * long that took and how much memory was copied, and exits. Reactors check
+ * on it every SAVE_POLL_MS.
+ *
+ * @param commandList The arguments.
+ * @param output Nil once the child runs.
+ */
+void Request::bgsave([[maybe_unused]] const Arguments &commandList,
+                     Output &output) const {
+  reapSave();
+  if (snapshotPath.empty()) {
+    return out::err(output, std::to_underlying(Error::UNKNOWN),
+                    "no snapshot file");
+  }
+  if (saveChild) {
+    return out::err(output, std::to_underlying(Error::UNKNOWN),
+                    "background save in progress");
+  }
 
-  const auto *node = map::pop(&commandMap.db, &key.node, &entryEquality);
+  std::array<int, 2> report{};
+  if (pipe2(report.data(), O_CLOEXEC) != 0) {
+    return out::err(output, std::to_underlying(Error::UNKNOWN), "fork failed");
+  }
+  auto start = std::chrono::steady_clock::now();
+  auto pid = fork();
+  if (pid == 0) {
+    // the child, only this thread came along and it holds the keyspace lock
+    ::close(report[0]);
+    auto written = std::chrono::steady_clock::now();
+    bool ok = saveSnapshot();
+    SaveReport sent{.saveUs = microsSince(written),
+                    .cowBytes = privateDirtyBytes()};
+    [[maybe_unused]] auto n = ::write(report[1], &sent, sizeof(sent));
+    _exit(ok ? 0 : 1);
+  }
 
-  if (node) {
-    delete containerOf(node, Entry, node);
+  lastForkUs = microsSince(start);
+  ::close(report[1]);
+  if (pid < 0) {
+    ::close(report[0]);
+    lastSaveOk = false;
+    return out::err(output, std::to_underlying(Error::UNKNOWN), "fork failed");
   }
+  saveChild = pid;
+  saveReport = report[0];
+  return out::nil(output);
+}
+
+/**
+ * @brief Calls @p fn with the index and hash of every key of a multi-key
+ * command, a batch at a time.
+ *
+ * A batch is hashed and its probe groups prefetched, then the matching
+ * entries are prefetched, and only then looked up, so the cache misses of the
+ * whole batch overlap instead of each lookup waiting on its own.
+ *
+ * @param commandList The arguments, the keys start at 1.
+ * @param step 1 if every argument is a key, 2 for key value pairs.
+ * @param fn Called with the argument index and the hash of the key.
+ */
+template <typename Fn>
+static void forEachKey(EntryMap &db, const Arguments &commandList,
+                       std::size_t step, Fn &&fn) {
+  std::array<std::uint64_t, PREFETCH_BATCH> codes{};
+  for (std::size_t first = 1; first < commandList.size();
+       first += step * PREFETCH_BATCH) {
+    std::size_t n =
+        std::min(PREFETCH_BATCH, (commandList.size() - first) / step);
+    for (std::size_t i = 0; i < n; ++i) {
+      codes[i] = stringHash(commandList[first + i * step]);
+      db.prefetch(codes[i]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      db.prefetchMatches(codes[i]);
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      fn(first + i * step, codes[i]);
+    }
+  }
+}
 
-  return out::num(output, node ? 1 : 0);
+void Request::mget(const Arguments &commandList, Output &output) const {
+  std::array<char, MAX_INT_DIGITS> scratch{};
+  out::arr(output, static_cast<std::uint32_t>(commandList.size() - 1));
+  forEachKey(commandMap.db, commandList, 1,
+             [&](std::size_t i, std::uint64_t code) {
+               const auto *entry = findKey(commandList[i], code);
+               if (entry && entry->type() == KeyType::STR) {
+                 out::str(output, entry->string(scratch));
+               } else {
+                 out::nil(output);
+               }
+             });
+}
+
+void Request::mset(const Arguments &commandList, Output &output) const {
+  if (commandList.size() % 2 == 0) {
+    return out::err(output, std::to_underlying(Error::ARITY),
+                    "wrong number of arguments");
+  }
+
+  forEachKey(commandMap.db, commandList, 2,
+             [&](std::size_t i, std::uint64_t code) {
+               auto *entry = replaceKey(commandList[i], code);
+               resize(entry, [&] { entry->setString(commandList[i + 1]); });
+             });
+  return out::nil(output);
+}
+
+void Request::mdel(const Arguments &commandList, Output &output) const {
+  std::int64_t deleted = 0;
+  forEachKey(commandMap.db, commandList, 1,
+             [&](std::size_t i, std::uint64_t code) {
+               if (auto *entry = findKey(commandList[i], code)) {
+                 dropKey(entry);
+                 deleted++;
+               }
+             });
+  return out::num(output, deleted);
 }
 
 auto Request::parse(std::uint8_t &requestData, std::size_t length,
-                    std::vector<std::string> &outputData) -> std::uint32_t {
+                    Arguments &outputData) -> std::uint32_t {
   if (length < 4) {
     return -1;
   }
@@ -249,9 +1185,9 @@ auto Request::parse(std::uint8_t &requestData, std::size_t length,
       return -1;
     }
 
-    outputData.emplace_back(
-        reinterpret_cast<char *>(&requestData + currentPosition + 4),
-        sizeOfData);
+    outputData.push_back(
+        {reinterpret_cast<char *>(&requestData + currentPosition + 4),
+         sizeOfData});
 
     currentPosition += 4 + sizeOfData;
   }
@@ -263,25 +1199,189 @@ auto Request::parse(std::uint8_t &requestData, std::size_t length,
   return 0;
 }
 
-void Request::operator()(std::vector<std::string> &commandList,
-                         std::string &out) {
-  if (commandList.size() == 1 && isCommand(commandList[0], "keys")) {
-    keys(commandList, out);
-  } else if (commandList.size() == 2 && isCommand(commandList[0], "get")) {
-    get(commandList, out);
-  } else if (commandList.size() == 3 && isCommand(commandList[0], "set")) {
-    set(commandList, out);
-  } else if (commandList.size() == 2 && isCommand(commandList[0], "del")) {
-    del(commandList, out);
-  } else if (commandList.size() == 4 && isCommand(commandList[0], "zadd")) {
-    zadd(commandList, out);
-  } else if (commandList.size() == 3 && isCommand(commandList[0], "zrem")) {
-    zrem(commandList, out);
-  } else if (commandList.size() == 3 && isCommand(commandList[0], "zscore")) {
-    zscore(commandList, out);
-  } else if (commandList.size() == 6 && isCommand(commandList[0], "zquery")) {
-    zquery(commandList, out);
-  } else {
-    out::err(out, std::to_underlying(Error::UNKNOWN), "Unknown cmd");
+auto Request::lookup(std::string_view name) -> const Command * {
+  auto slot = COMMAND_INDEX[commandHash(name, COMMAND_SEED)];
+  if (!slot) {
+    return nullptr;
+  }
+  const auto *command = &commands[slot - 1];
+  if (name.size() != command->name.size() ||
+      0 != strncasecmp(name.data(), command->name.data(), name.size())) {
+    return nullptr; // another name that hashes to the same slot
+  }
+  return command;
+}
+
+auto Request::idle() -> bool {
+  auto deadline = std::chrono::steady_clock::now() + IDLE_WORK_SLICE;
+  do {
+    std::unique_lock lock(commandMap.mutex, std::try_to_lock);
+    if (!lock) {
+      return true; // another reactor is busy with the keyspace
+    }
+    reapSave();
+    bool resizing = commandMap.db.rehash();
+    bool due = expireDue(EXPIRE_WORK);
+    bool over = evictToLimit(EVICT_WORK);
+    if (!resizing && !due && !over) {
+      return false;
+    }
+  } while (std::chrono::steady_clock::now() < deadline);
+  return true;
+}
+
+auto Request::timeout() -> std::int32_t {
+  std::scoped_lock lock(commandMap.mutex);
+  // a BGSAVE child has to be collected even if no key expires
+  std::int32_t most = saveChild ? SAVE_POLL_MS : -1;
+  if (commandMap.ttl.empty()) {
+    return most;
   }
-}
\ No newline at end of file
+  auto deadline = commandMap.ttl.topDeadline();
+  auto now = nowMs();
+  auto left = static_cast<std::int32_t>(
+      deadline <= now ? 0
+                      : std::min<std::uint64_t>(
+                            deadline - now,
+                            std::numeric_limits<std::int32_t>::max()));
+  return most >= 0 ? std::min(left, most) : left;
+}
+
+void Request::limitMemory(std::size_t limit, Eviction policy) {
+  std::scoped_lock lock(commandMap.mutex);
+  maxMemory = limit;
+  evictionPolicy = policy;
+}
+
+void Request::loadSnapshot(const std::string &path, bool load) {
+  std::scoped_lock lock(commandMap.mutex);
+  snapshotPath = path;
+  if (path.empty() || !load) {
+    return;
+  }
+
+  auto now = nowMs();
+  auto wall = wallMs();
+  auto access = evict::created(evictionPolicy, coarseMs());
+
+  // the keys go in a batch at a time, with the probe groups of the batch
+  // prefetched first, so their cache misses overlap as in forEachKey
+  struct Loaded {
+    Entry *entry;
+    std::uint64_t code;
+    std::int64_t expireAt;
+  };
+  std::array<Loaded, PREFETCH_BATCH> batch{};
+  std::size_t pending = 0;
+  auto insertBatch = [&] {
+    for (std::size_t i = 0; i < pending; ++i) {
+      auto [entry, code, expireAt] = batch[i];
+      commandMap.db.insert(entry, code);
+      keyBytes += entry->memory();
+      if (expireAt) {
+        auto left = static_cast<std::uint64_t>(expireAt - wall);
+        commandMap.ttl.set(entry, now + left);
+      }
+    }
+    pending = 0;
+  };
+
+  snapshot::load(
+      path, [](std::uint64_t keys) { commandMap.db.reserve(keys); },
+      [&](Entry *entry, std::int64_t expireAt) {
+        if (expireAt && expireAt <= wall) {
+          return Entry::destroy(entry); // expired while the server was down
+        }
+        entry->access = access;
+        auto code = EntryHash{}(std::as_const(*entry));
+        commandMap.db.prefetch(code);
+        batch[pending++] = {entry, code, expireAt};
+        if (pending == PREFETCH_BATCH) {
+          insertBatch();
+        }
+      });
+  insertBatch();
+}
+
+void Request::openLog(const std::string &path, Fsync policy) {
+  if (path.empty()) {
+    return;
+  }
+
+  // the commands run as if a client sent them, before they are logged again
+  ChunkedBuffer replies(ChunkPool::shared);
+  Request request;
+  replaying = true;
+  aof::replay(path, [&](std::span<std::uint8_t> frame) {
+    Arguments command;
+    if (frame.size() < 4 ||
+        0 != request.parse(frame.front(), frame.size(), command)) {
+      throw std::runtime_error("Bad command in append-only log " + path);
+    }
+    Output output(replies);
+    request(command, output);
+    replies.consume(replies.size());
+  });
+  replaying = false;
+  aof::open(path, policy);
+}
+
+/**
+ * @brief Appends a write command to the log.
+ *
+ * EXPIRE and PEXPIRE go in as PEXPIREAT, so a replay keeps the deadline
+ * instead of starting it over.
+ *
+ * @param command The command that ran.
+ * @param commandList Its arguments.
+ */
+void Request::logWrite(const Command *command, const Arguments &commandList) {
+  std::int64_t unit = command->handler == &Request::expire    ? 1000
+                      : command->handler == &Request::pexpire ? 1
+                                                              : 0;
+  if (!unit) {
+    return aof::append({commandList.begin(), commandList.size()});
+  }
+
+  std::int64_t after = 0;
+  if (!strToInt(commandList[2], after) ||
+      after > std::numeric_limits<std::int64_t>::max() / unit / 2) {
+    return; // refused, nothing changed
+  }
+  auto at = std::to_string(after <= 0 ? 0 : wallMs() + after * unit);
+  std::array<std::string_view, 3> args = {"pexpireat", commandList[1], at};
+  aof::append(args);
+}
+
+void Request::operator()(const Arguments &commandList, Output &out) {
+  const auto *command = commandList.size() ? lookup(commandList[0]) : nullptr;
+  if (!command) {
+    return out::err(out, std::to_underlying(Error::UNKNOWN), "Unknown cmd");
+  }
+  if (!command->accepts(commandList.size())) {
+    return out::err(out, std::to_underlying(Error::ARITY),
+                    "wrong number of arguments");
+  }
+  if (command->is(CommandFlag::WRITE) && aof::failing()) {
+    return out::err(out, std::to_underlying(Error::LOG),
+                    "append-only log failing");
+  }
+
+  // even lookups mutate the map (incremental resizing), so take it exclusively
+  std::scoped_lock lock(commandMap.mutex);
+  commandCalls[command - commands]++;
+  if (command->is(CommandFlag::WRITE)) {
+    evictToLimit(EVICT_WORK); // makes room before the write, not after
+  }
+  (this->*command->handler)(commandList, out);
+  if (command->is(CommandFlag::WRITE) && aof::enabled()) {
+    logWrite(command, commandList); // in the order the writes ran
+  }
+
+  // keeps expiring keys while the reactors are too busy to be idle
+  if (++callsSinceExpiry == EXPIRE_CHECK_CALLS) {
+    callsSinceExpiry = 0;
+    expireDue(EXPIRE_WORK);
+    reapSave();
+  }
+}
@@ -1,48 +1,244 @@
 #pragma once
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <mutex>
 #include <print>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "aof.hxx"
+#include "buffer.hxx"
 #include "entry.hxx"
+#include "evict.hxx"
+#include "heap.hxx"
 #include "serialize.hxx"
 
 constexpr std::int64_t PORT = 1234;
-constexpr std::size_t MAX_MESSAGE_SIZE = 4096;
+constexpr std::size_t MAX_MESSAGE_SIZE = 32 << 20; // --max-message-size
 constexpr std::size_t MAX_NUM_ARGS = 1024;
+constexpr std::size_t INLINE_NUM_ARGS = 8;
+constexpr std::chrono::microseconds IDLE_WORK_SLICE{200};
+constexpr std::size_t EXPIRE_WORK = 64;          // keys per active expiry step
+constexpr std::uint32_t EXPIRE_CHECK_CALLS = 128; // commands between steps
+constexpr std::size_t EVICT_WORK = 16;            // keys per eviction step
+constexpr std::int32_t SAVE_POLL_MS = 100; // how often BGSAVE is checked on
 
 enum class Error : std::int32_t {
   UNKNOWN = 1,
   TOO_BIG = 2,
   TYPE = 3,
   ARG = 4,
+  ARITY = 5,
+  LOG = 6, // the append-only log is failing, writes are refused
 };
 
+/**
+ * Flags of a command, what it does to the keyspace.
+ */
+enum class CommandFlag : std::uint8_t {
+  READ = 1 << 0,
+  WRITE = 1 << 1,
+};
+
+/**
+ * @class Arguments
+ * @brief The arguments of one request, viewed in place in the read buffer.
+ *
+ * The first INLINE_NUM_ARGS views are stored inside the object, so parsing
+ * any of the regular commands allocates nothing. The views are valid until
+ * the request is consumed from the read buffer, a handler copies the bytes
+ * it wants to keep.
+ */
+class Arguments {
+public:
+  /**
+   * @brief Appends a view to the arguments.
+   *
+   * @param arg The argument bytes, owned by the read buffer.
+   */
+  void push_back(std::string_view arg) {
+    if (count < INLINE_NUM_ARGS) [[likely]] {
+      inlineArgs[count++] = arg;
+      return;
+    }
+    if (count == INLINE_NUM_ARGS) {
+      spilledArgs.assign(inlineArgs.begin(), inlineArgs.end());
+    }
+    spilledArgs.push_back(arg);
+    count++;
+  }
+
+  auto size() const -> std::size_t { return count; }
+  auto operator[](std::size_t i) const -> std::string_view { return data()[i]; }
+  auto begin() const -> const std::string_view * { return data(); }
+  auto end() const -> const std::string_view * { return data() + count; }
+
+private:
+  auto data() const -> const std::string_view * {
+    return count <= INLINE_NUM_ARGS ? inlineArgs.data() : spilledArgs.data();
+  }
+
+  std::array<std::string_view, INLINE_NUM_ARGS> inlineArgs;
+  std::vector<std::string_view> spilledArgs;
+  std::size_t count = 0;
+};
+
+using DeadlineMap = DeadlineHeap<Entry, &Entry::heapIndex>;
+
 struct CommandMap {
-  Map db;
+  EntryMap db;
+  DeadlineMap ttl; // expiry deadlines in steady clock milliseconds
+  std::mutex mutex; // shared by every reactor thread
+};
+
+class Request;
+
+/**
+ * @struct Command
+ * @brief An entry of the command table.
+ *
+ */
+struct Command {
+  std::string_view name; /** Lower case */
+  std::int32_t arity;    /** Arguments including the name, -n for at least n */
+  std::uint8_t flags;    /** CommandFlag bits */
+  void (Request::*handler)(const Arguments &, Output &) const;
+
+  auto accepts(std::size_t numArgs) const -> bool {
+    return arity >= 0 ? numArgs == static_cast<std::size_t>(arity)
+                      : numArgs >= static_cast<std::size_t>(-arity);
+  }
+  auto is(CommandFlag flag) const -> bool {
+    return flags & std::to_underlying(flag);
+  }
 };
 
 class Request {
 public:
   Request() = default;
-  void operator()(std::vector<std::string> &commandList, std::string &out);
+  void operator()(const Arguments &commandList, Output &out);
 
   auto parse(std::uint8_t &requestData, std::size_t length,
-             std::vector<std::string> &outputData) -> std::uint32_t;
+             Arguments &outputData) -> std::uint32_t;
+
+  /**
+   * @brief Finds a command by name, ignoring case.
+   *
+   * @param name The first argument of a request.
+   * @return the table entry, or nullptr for an unknown command.
+   */
+  static auto lookup(std::string_view name) -> const Command *;
+
+  /**
+   * @brief Runs background work on the keyspace, such as a pending resize.
+   *
+   * Meant for when a reactor has nothing else to do. Runs for at most
+   * IDLE_WORK_SLICE, and backs off if another reactor holds the keyspace.
+   *
+   * @return true if there is work left.
+   */
+  static auto idle() -> bool;
+
+  /**
+   * @brief Get how long a reactor may block before a key has to expire.
+   *
+   * @return the milliseconds until the nearest deadline, -1 if there is none.
+   */
+  static auto timeout() -> std::int32_t;
+
+  /**
+   * @brief Limits the memory of the keyspace, evicting keys to stay under it.
+   *
+   * Write commands first evict up to EVICT_WORK keys while the keyspace is
+   * over the limit, and `idle()` goes on from there.
+   *
+   * @param limit The most bytes the keys may take, 0 for no limit.
+   * @param policy Which keys are evicted first.
+   */
+  static void limitMemory(std::size_t limit, Eviction policy);
+
+  /**
+   * @brief Sets the snapshot file and loads the keys saved in it, if any.
+   *
+   * Meant for startup, before any reactor runs. Keys already past their
+   * expiry are dropped.
+   *
+   * @param path The file SAVE and BGSAVE write, empty to have none.
+   * @param load false to only set the file, when the log restores the keys.
+   * @throws std::runtime_error If the file is there but not a whole snapshot.
+   */
+  static void loadSnapshot(const std::string &path, bool load);
+
+  /**
+   * @brief Replays the append-only log, then logs every write command to it.
+   *
+   * Meant for startup, before any reactor runs. The reactors flush the log
+   * before they send the replies of a loop iteration.
+   *
+   * @param path The log file, empty to log nothing.
+   * @param policy When the log is synced to disk.
+   * @throws std::runtime_error If the file can not be read or opened.
+   */
+  static void openLog(const std::string &path, Fsync policy);
+
+  /** Every command the server knows, built at compile time. */
+  static const Command commands[];
 
 private:
   static CommandMap commandMap;
-  void keys([[maybe_unused]] std::vector<std::string> &commandList,
-            std::string &output) const;
-  void get(std::vector<std::string> &commandList, std::string &output) const;
-  void set(std::vector<std::string> &commandList, std::string &output) const;
-  void del(std::vector<std::string> &commandList, std::string &output) const;
-  void zadd(std::vector<std::string> &commandList, std::string &output) const;
-  void zrem(std::vector<std::string> &commandList, std::string &output) const;
-  void zscore(std::vector<std::string> &commandList, std::string &output) const;
-  void zquery(std::vector<std::string> &commandList, std::string &output) const;
-  auto isCommand(const std::string &word, const char *commandList) const;
-  auto expectZSet(std::string &output, std::string &s, Entry **entry) const;
+  void keys([[maybe_unused]] const Arguments &commandList,
+            Output &output) const;
+  void scan(const Arguments &commandList, Output &output) const;
+  void stats([[maybe_unused]] const Arguments &commandList,
+             Output &output) const;
+  void get(const Arguments &commandList, Output &output) const;
+  void set(const Arguments &commandList, Output &output) const;
+  void del(const Arguments &commandList, Output &output) const;
+  void mget(const Arguments &commandList, Output &output) const;
+  void mset(const Arguments &commandList, Output &output) const;
+  void mdel(const Arguments &commandList, Output &output) const;
+  void zadd(const Arguments &commandList, Output &output) const;
+  void zrem(const Arguments &commandList, Output &output) const;
+  void zscore(const Arguments &commandList, Output &output) const;
+  void zquery(const Arguments &commandList, Output &output) const;
+  void expire(const Arguments &commandList, Output &output) const;
+  void pexpire(const Arguments &commandList, Output &output) const;
+  void pexpireat(const Arguments &commandList, Output &output) const;
+  void ttl(const Arguments &commandList, Output &output) const;
+  void pttl(const Arguments &commandList, Output &output) const;
+  void persist(const Arguments &commandList, Output &output) const;
+  void incr(const Arguments &commandList, Output &output) const;
+  void decr(const Arguments &commandList, Output &output) const;
+  void incrby(const Arguments &commandList, Output &output) const;
+  void decrby(const Arguments &commandList, Output &output) const;
+  void incrbyfloat(const Arguments &commandList, Output &output) const;
+  void save(const Arguments &commandList, Output &output) const;
+  void bgsave(const Arguments &commandList, Output &output) const;
+  auto expectZSet(Output &output, std::string_view s, Entry **entry) const;
+  void expireAfter(const Arguments &commandList, Output &output,
+                   std::int64_t unit) const;
+  void timeToLive(const Arguments &commandList, Output &output,
+                  std::int64_t unit) const;
+  void incrementBy(const Arguments &commandList, Output &output,
+                   std::int64_t sign) const;
+
+  static auto findKey(std::string_view key, std::uint64_t code) -> Entry *;
+  static auto addKey(std::string_view key, std::uint64_t code) -> Entry *;
+  static auto replaceKey(std::string_view key, std::uint64_t code) -> Entry *;
+  static void touch(Entry *entry);
+  static auto expired(const Entry *entry, std::uint64_t now) -> bool;
+  static void expireKey(Entry *entry);
+  static void dropKey(Entry *entry);
+  static void freeKey(Entry *entry);
+  static auto expireDue(std::size_t budget) -> bool;
+  static auto usedMemory() -> std::size_t;
+  static auto evictToLimit(std::size_t budget) -> bool;
+  static auto saveSnapshot() -> bool;
+  static void reapSave();
+  static void logWrite(const Command *command, const Arguments &commandList);
 };
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include <cmath>
 #include <cstdint>
 #include <string>
+#include <string_view>
+
+#include "buffer.hxx"
 
 enum class Serialize : std::uint8_t {
   NIL = 0,
@@ -13,15 +16,102 @@ enum class Serialize : std::uint8_t {
   ARR = 6,
 };
 
+/**
+ * @class Output
+ * @brief Builds one response frame in place at the back of an output buffer.
+ *
+ * The 4-byte length header is reserved up front and backpatched by
+ * `finish()`, the same way `out::begin_arr()` and `out::end_arr()` fill in the
+ * length of an array, so a response is never staged in a temporary.
+ */
+class Output {
+public:
+  /**
+   * @brief Construct a new Output object
+   *
+   * Reserves the length header of the frame at the back of @p buffer.
+   *
+   * @param buffer The buffer the frame is appended to.
+   */
+  explicit Output(ChunkedBuffer &buffer)
+      : buffer(buffer), start(buffer.size()) {
+    buffer.append("\0\0\0\0", 4); // filled in finish()
+  }
+
+  /**
+   * @brief Appends one byte to the response.
+   *
+   * @param byte The byte to append.
+   */
+  void push(std::uint8_t byte) { buffer.append(&byte, 1); }
+
+  /**
+   * @brief Appends @p n bytes to the response.
+   *
+   * @param data The bytes to append.
+   * @param n The number of bytes to append.
+   */
+  void append(const void *data, std::size_t n) { buffer.append(data, n); }
+
+  /**
+   * @brief Get the size of the response written so far.
+   *
+   * @return the number of bytes after the length header.
+   */
+  auto size() const -> std::size_t { return buffer.size() - start - 4; }
+
+  /**
+   * @brief Get a byte of the response written so far.
+   *
+   * @param i The position of the byte after the length header.
+   * @return the byte.
+   */
+  auto operator[](std::size_t i) const -> std::uint8_t {
+    std::uint8_t byte = 0;
+    buffer.copy(start + 4 + i, &byte, 1);
+    return byte;
+  }
+
+  /**
+   * @brief Overwrites @p n bytes of the response written so far.
+   *
+   * @param offset The position of the first byte after the length header.
+   * @param data The bytes to write.
+   * @param n The number of bytes to write.
+   */
+  void patch(std::size_t offset, const void *data, std::size_t n) {
+    buffer.patch(start + 4 + offset, data, n);
+  }
+
+  /**
+   * @brief Drops the response written so far, keeping the length header.
+   *
+   */
+  void clear() { buffer.truncate(start + 4); }
+
+  /**
+   * @brief Completes the frame by filling in its length header.
+   *
+   */
+  void finish() {
+    auto len = static_cast<std::uint32_t>(size());
+    buffer.patch(start, &len, 4);
+  }
+
+private:
+  ChunkedBuffer &buffer;
+  std::size_t start; // offset of the length header in the buffer
+};
+
 namespace out {
 
-void nil(std::string &out);
-void str(std::string &out, const std::string &val);
-void num(std::string &out, std::int64_t val);
-void dbl(std::string &out, std::double_t val);
-void err(std::string &out, std::int32_t code, const std::string &msg);
-void arr(std::string &out, std::uint32_t n);
-auto begin_arr(std::string &out) -> void *;
-void end_arr(std::string &out, void *ctx, std::uint32_t n);
+void nil(Output &out);
+void str(Output &out, std::string_view val);
+void num(Output &out, std::int64_t val);
+void dbl(Output &out, std::double_t val);
+void err(Output &out, std::int32_t code, const std::string &msg);
+void arr(Output &out, std::uint32_t n);
+auto begin_arr(Output &out) -> void *;
+void end_arr(Output &out, void *ctx, std::uint32_t n);
 
 } // namespace out
\ No newline at end of file
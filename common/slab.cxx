@@ -0,0 +1,185 @@
+#include "slab.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+
+struct FreeObject {
+  FreeObject *next;
+};
+
+constexpr auto objectSize(std::size_t sizeClass) -> std::size_t {
+  return (sizeClass + 1) * SLAB_ALIGNMENT;
+}
+
+constexpr auto objectsPerPage(std::size_t sizeClass) -> std::size_t {
+  return SLAB_PAGE_SIZE / objectSize(sizeClass);
+}
+
+struct ThreadCache;
+
+// the free lists every thread cache refills from and flushes to
+struct Central {
+  struct Class {
+    FreeObject *free = nullptr;
+    std::size_t freeCount = 0;
+    std::size_t pages = 0;
+  };
+
+  ~Central() {
+    for (auto *page : pages) {
+      ::operator delete(page);
+    }
+  }
+
+  std::mutex mutex;
+  std::array<Class, SLAB_CLASSES> classes;
+  std::vector<void *> pages;
+  std::vector<const ThreadCache *> caches;
+};
+
+auto central() -> Central & {
+  static Central instance;
+  return instance;
+}
+
+struct ThreadCache {
+  ThreadCache() {
+    auto &shared = central();
+    std::scoped_lock lock(shared.mutex);
+    shared.caches.push_back(this);
+  }
+
+  ~ThreadCache() {
+    auto &shared = central();
+    for (std::size_t i = 0; i < SLAB_CLASSES; ++i) {
+      flush(i, cached(i));
+    }
+    std::scoped_lock lock(shared.mutex);
+    std::erase(shared.caches, this);
+  }
+
+  ThreadCache(const ThreadCache &) = delete;
+  auto operator=(const ThreadCache &) -> ThreadCache & = delete;
+
+  auto pop(std::size_t sizeClass) -> void * {
+    if (!heads[sizeClass]) [[unlikely]] {
+      refill(sizeClass);
+    }
+    auto *object = heads[sizeClass];
+    heads[sizeClass] = object->next;
+    setCached(sizeClass, cached(sizeClass) - 1);
+    return object;
+  }
+
+  void push(std::size_t sizeClass, void *memory) {
+    auto *object = static_cast<FreeObject *>(memory);
+    object->next = heads[sizeClass];
+    heads[sizeClass] = object;
+    setCached(sizeClass, cached(sizeClass) + 1);
+    if (cached(sizeClass) >= SLAB_CACHE_SIZE) [[unlikely]] {
+      flush(sizeClass, SLAB_CACHE_SIZE / 2);
+    }
+  }
+
+  // takes half a cache worth of objects, carving a page if there are none
+  void refill(std::size_t sizeClass) {
+    auto &shared = central();
+    std::scoped_lock lock(shared.mutex);
+    auto &slab = shared.classes[sizeClass];
+    if (!slab.free) {
+      auto *page = static_cast<char *>(::operator new(SLAB_PAGE_SIZE));
+      shared.pages.push_back(page);
+      slab.pages++;
+      for (std::size_t i = objectsPerPage(sizeClass); i > 0; --i) {
+        auto *object = reinterpret_cast<FreeObject *>(
+            page + (i - 1) * objectSize(sizeClass));
+        object->next = slab.free;
+        slab.free = object;
+      }
+      slab.freeCount += objectsPerPage(sizeClass);
+    }
+
+    std::size_t n = std::min(SLAB_CACHE_SIZE / 2, slab.freeCount);
+    for (std::size_t i = 0; i < n; ++i) {
+      auto *object = slab.free;
+      slab.free = object->next;
+      object->next = heads[sizeClass];
+      heads[sizeClass] = object;
+    }
+    slab.freeCount -= n;
+    setCached(sizeClass, cached(sizeClass) + n);
+  }
+
+  // gives `n` objects back to the shared free list
+  void flush(std::size_t sizeClass, std::size_t n) {
+    auto &shared = central();
+    std::scoped_lock lock(shared.mutex);
+    auto &slab = shared.classes[sizeClass];
+    for (std::size_t i = 0; i < n; ++i) {
+      auto *object = heads[sizeClass];
+      heads[sizeClass] = object->next;
+      object->next = slab.free;
+      slab.free = object;
+    }
+    slab.freeCount += n;
+    setCached(sizeClass, cached(sizeClass) - n);
+  }
+
+  auto cached(std::size_t sizeClass) const -> std::size_t {
+    return counts[sizeClass].load(std::memory_order_relaxed);
+  }
+
+  void setCached(std::size_t sizeClass, std::size_t n) {
+    counts[sizeClass].store(n, std::memory_order_relaxed);
+  }
+
+  std::array<FreeObject *, SLAB_CLASSES> heads = {};
+  // written by the owner only, read by `stats()` from any thread
+  std::array<std::atomic<std::size_t>, SLAB_CLASSES> counts = {};
+};
+
+thread_local ThreadCache cache;
+
+} // namespace
+
+namespace slab {
+
+auto allocate(std::size_t size) -> void * {
+  if (size > SLAB_MAX_SIZE) [[unlikely]] {
+    return ::operator new(size);
+  }
+  return cache.pop(sizeClass(size));
+}
+
+void deallocate(void *object, std::size_t size) {
+  if (!object) {
+    return;
+  }
+  if (size > SLAB_MAX_SIZE) [[unlikely]] {
+    return ::operator delete(object);
+  }
+  cache.push(sizeClass(size), object);
+}
+
+auto stats() -> SlabStats {
+  auto &shared = central();
+  std::scoped_lock lock(shared.mutex);
+  SlabStats stats;
+  for (std::size_t i = 0; i < SLAB_CLASSES; ++i) {
+    std::size_t free = shared.classes[i].freeCount;
+    for (const auto *threadCache : shared.caches) {
+      free += threadCache->cached(i);
+    }
+    stats.pages[i] = shared.classes[i].pages;
+    stats.free[i] = free;
+    stats.live[i] = stats.pages[i] * objectsPerPage(i) - free;
+  }
+  return stats;
+}
+
+} // namespace slab
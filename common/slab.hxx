@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+/**
+ * Objects up to SLAB_MAX_SIZE bytes come from slabs, in size classes
+ * SLAB_ALIGNMENT bytes apart. A page is carved into objects of one class.
+ */
+constexpr std::size_t SLAB_ALIGNMENT = 8;
+constexpr std::size_t SLAB_MAX_SIZE = 256;
+constexpr std::size_t SLAB_CLASSES = SLAB_MAX_SIZE / SLAB_ALIGNMENT;
+constexpr std::size_t SLAB_PAGE_SIZE = 64 * 1024;
+constexpr std::size_t SLAB_CACHE_SIZE = 64; // per size class and thread
+
+/**
+ * @struct SlabStats
+ * @brief A snapshot of the object counts of the slabs, per size class.
+ *
+ */
+struct SlabStats {
+  std::array<std::size_t, SLAB_CLASSES> live = {};  /** Handed out */
+  std::array<std::size_t, SLAB_CLASSES> free = {};  /** Kept for reuse */
+  std::array<std::size_t, SLAB_CLASSES> pages = {}; /** Carved so far */
+};
+
+/**
+ * Size class slab pools for the small, fixed shape objects of the keyspace.
+ *
+ * Every thread keeps up to SLAB_CACHE_SIZE free objects per size class and
+ * only takes the lock to move half of that to or from the shared free lists,
+ * so the common allocation is a pop off a thread local list. Pages are kept
+ * for the life of the process, freed objects go back on the free lists.
+ */
+namespace slab {
+
+/**
+ * @brief Get the size class of an object of @p size bytes.
+ *
+ * @param size The object size, at most SLAB_MAX_SIZE.
+ * @return the index into the SlabStats arrays.
+ */
+constexpr auto sizeClass(std::size_t size) -> std::size_t {
+  return size ? (size - 1) / SLAB_ALIGNMENT : 0;
+}
+
+/**
+ * @brief Get how many bytes an object of @p size bytes really takes.
+ *
+ * @param size The object size.
+ * @return the size of its size class, or @p size for a large object.
+ */
+constexpr auto allocationSize(std::size_t size) -> std::size_t {
+  return size > SLAB_MAX_SIZE ? size : (sizeClass(size) + 1) * SLAB_ALIGNMENT;
+}
+
+/**
+ * @brief Allocates @p size bytes aligned to SLAB_ALIGNMENT.
+ *
+ * Larger objects than SLAB_MAX_SIZE come from operator new.
+ *
+ * @param size The object size.
+ * @return the memory, never nullptr.
+ */
+auto allocate(std::size_t size) -> void *;
+
+/**
+ * @brief Frees memory from `allocate`.
+ *
+ * @param object The memory, or nullptr.
+ * @param size The size it was allocated with.
+ */
+void deallocate(void *object, std::size_t size);
+
+/**
+ * @brief Get the current object counts.
+ *
+ * @return how many objects of every size class are live and free.
+ */
+auto stats() -> SlabStats;
+
+} // namespace slab
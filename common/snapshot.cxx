@@ -0,0 +1,455 @@
+#include "snapshot.hxx"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+SnapshotWriter::SnapshotWriter(int fd, std::uint64_t keys)
+    : fd(fd), buffer(new char[SNAPSHOT_BUFFER_SIZE]) {
+  put(SNAPSHOT_MAGIC.data(), SNAPSHOT_MAGIC.size());
+  put(&SNAPSHOT_VERSION, sizeof(SNAPSHOT_VERSION));
+  put(&keys, sizeof(keys));
+}
+
+void SnapshotWriter::add(const Entry &entry, std::int64_t expireAt) {
+  std::int64_t num = 0;
+  auto record = entry.type() == KeyType::ZSET ? Record::ZSET
+                : entry.integer(num)          ? Record::INT
+                                              : Record::STR;
+  put(&record, sizeof(record));
+  put(&expireAt, sizeof(expireAt));
+  putString(entry.key());
+
+  switch (record) {
+  case Record::STR: {
+    std::array<char, MAX_INT_DIGITS> scratch{};
+    putString(entry.string(scratch));
+    break;
+  }
+  case Record::INT:
+    put(&num, sizeof(num));
+    break;
+  case Record::ZSET: {
+    const auto *set = entry.zset();
+    auto count = static_cast<std::uint32_t>(zset::size(set));
+    put(&count, sizeof(count));
+    for (auto cursor = zset::query(set, -INFINITY, "", 0); cursor;
+         cursor = zset::offset(cursor, +1)) {
+      auto member = zset::member(cursor);
+      put(&member.score, sizeof(member.score));
+      putString(member.name);
+    }
+    break;
+  }
+  case Record::END:
+    break;
+  }
+}
+
+auto SnapshotWriter::finish() -> bool {
+  auto end = Record::END;
+  put(&end, sizeof(end));
+  flush();
+  return ok;
+}
+
+void SnapshotWriter::put(const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    if (used == SNAPSHOT_BUFFER_SIZE) {
+      flush();
+    }
+    auto n = std::min(size, SNAPSHOT_BUFFER_SIZE - used);
+    std::memcpy(buffer.get() + used, bytes, n);
+    used += n;
+    bytes += n;
+    size -= n;
+  }
+}
+
+void SnapshotWriter::putString(std::string_view s) {
+  auto size = static_cast<std::uint32_t>(s.size());
+  put(&size, sizeof(size));
+  put(s.data(), s.size());
+}
+
+void SnapshotWriter::flush() {
+  std::size_t done = 0;
+  while (ok && done < used) {
+    auto n = ::write(fd, buffer.get() + done, used - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    ok = n > 0;
+    done += ok ? static_cast<std::size_t>(n) : 0;
+  }
+  used = 0;
+}
+
+namespace {
+
+/**
+ * @class Mapping
+ * @brief A whole file mapped read only, for as long as the object lives.
+ *
+ */
+class Mapping {
+public:
+  // closes `fd`, the mapping keeps the file
+  explicit Mapping(int fd) {
+    struct stat st {};
+    bool ok = ::fstat(fd, &st) == 0;
+    size = ok ? static_cast<std::size_t>(st.st_size) : 0;
+    void *addr = nullptr;
+    if (size > 0) { // the reader throws at an empty file
+      addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = addr != MAP_FAILED;
+    }
+    ::close(fd);
+    if (!ok) {
+      throw std::runtime_error("Failed to map snapshot");
+    }
+    if (size == 0) {
+      return;
+    }
+    ::madvise(addr, size, MADV_SEQUENTIAL); // read ahead of the parser
+    data = static_cast<const char *>(addr);
+  }
+
+  Mapping(const Mapping &) = delete;
+  auto operator=(const Mapping &) -> Mapping & = delete;
+
+  ~Mapping() {
+    if (data) {
+      ::munmap(const_cast<char *>(data), size);
+    }
+  }
+
+  const char *data = nullptr;
+  std::size_t size = 0;
+};
+
+/**
+ * @class SnapshotReader
+ * @brief Reads a mapped snapshot in place, throwing past its end.
+ *
+ */
+class SnapshotReader {
+public:
+  SnapshotReader(const char *data, std::size_t size)
+      : next(data), end(data + size) {}
+
+  // the next `size` bytes, skipped
+  auto take(std::size_t size) -> const char * {
+    if (static_cast<std::size_t>(end - next) < size) {
+      throw std::runtime_error("Truncated snapshot");
+    }
+    const char *at = next;
+    next += size;
+    return at;
+  }
+
+  template <typename T> auto get() -> T {
+    T value{};
+    std::memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+  }
+
+  auto getString() -> std::string_view {
+    auto size = get<std::uint32_t>();
+    return {take(size), size};
+  }
+
+  auto left() const -> std::size_t { return end - next; }
+
+private:
+  const char *next;
+  const char *end;
+};
+
+/**
+ * @struct ZSetJob
+ * @brief A sorted set whose members are still to be decoded.
+ *
+ */
+struct ZSetJob {
+  Entry *entry = nullptr; // nullptr once delivered, or found out of order
+  std::int64_t expireAt = 0;
+  const char *members = nullptr; // in the mapping, bounds checked
+  std::uint32_t count = 0;
+};
+
+/**
+ * @class ZSetDecoder
+ * @brief Builds sorted sets on a pool of threads while the keys are parsed.
+ *
+ * The parser hands over batches of sets whose bytes it has bounds checked,
+ * the threads build them, and every hand over delivers the batches finished
+ * so far on the parser's thread. Without threads to spare, a batch is built
+ * as soon as it is handed over.
+ */
+class ZSetDecoder {
+public:
+  using Deliver = std::function<void(Entry *, std::int64_t)>;
+
+  ZSetDecoder(std::size_t threads, const Deliver &fn) : fn(fn) {
+    for (std::size_t i = 0; i < threads; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ZSetDecoder(const ZSetDecoder &) = delete;
+  auto operator=(const ZSetDecoder &) -> ZSetDecoder & = delete;
+
+  // destroys the sets that were never delivered, after an error
+  ~ZSetDecoder() {
+    close();
+    destroy(batch);
+    for (auto *batches : {&todo, &done}) {
+      for (auto &jobs : *batches) {
+        destroy(jobs);
+      }
+    }
+  }
+
+  void add(ZSetJob job) {
+    batchMembers += job.count + 1;
+    batch.push_back(job);
+    if (batchMembers >= SNAPSHOT_BATCH_MEMBERS) {
+      submit();
+    }
+  }
+
+  // builds and delivers the rest, then throws if any set was bad
+  void finish() {
+    submit();
+    close();
+    deliver();
+    if (bad) {
+      throw std::runtime_error("Bad snapshot sorted set");
+    }
+  }
+
+private:
+  // calls `fn` with the sets built so far
+  void deliver() {
+    std::deque<std::vector<ZSetJob>> finished;
+    {
+      std::scoped_lock lock(mutex);
+      finished.swap(done);
+    }
+    for (auto &jobs : finished) {
+      for (auto &job : jobs) {
+        if (job.entry) {
+          fn(std::exchange(job.entry, nullptr), job.expireAt);
+        }
+      }
+    }
+  }
+
+  void submit() {
+    if (batch.empty()) {
+      return;
+    }
+    if (workers.empty()) {
+      build(batch);
+    }
+    {
+      std::scoped_lock lock(mutex);
+      (workers.empty() ? done : todo).push_back(std::move(batch));
+    }
+    ready.notify_one();
+    batch = {};
+    batchMembers = 0;
+    deliver();
+  }
+
+  void close() {
+    {
+      std::scoped_lock lock(mutex);
+      closed = true;
+    }
+    ready.notify_all();
+    workers.clear(); // joins
+  }
+
+  void work() {
+    std::unique_lock lock(mutex);
+    while (true) {
+      ready.wait(lock, [this] { return closed || !todo.empty(); });
+      if (todo.empty()) {
+        return; // closed, and nothing left
+      }
+      auto jobs = std::move(todo.front());
+      todo.pop_front();
+      lock.unlock();
+      build(jobs);
+      lock.lock();
+      done.push_back(std::move(jobs));
+    }
+  }
+
+  void build(std::vector<ZSetJob> &jobs) {
+    std::vector<ZMember> members;
+    for (auto &job : jobs) {
+      members.resize(job.count);
+      const char *p = job.members;
+      for (auto &member : members) {
+        std::uint32_t size = 0;
+        std::memcpy(&member.score, p, sizeof(member.score));
+        std::memcpy(&size, p + sizeof(member.score), sizeof(size));
+        p += sizeof(member.score) + sizeof(size);
+        member.name = {p, size};
+        p += size;
+      }
+      if (!zset::build(job.entry->zset(), members)) {
+        Entry::destroy(std::exchange(job.entry, nullptr));
+        bad = true;
+      }
+    }
+  }
+
+  static void destroy(std::vector<ZSetJob> &jobs) {
+    for (auto &job : jobs) {
+      if (job.entry) {
+        Entry::destroy(std::exchange(job.entry, nullptr));
+      }
+    }
+  }
+
+  const Deliver &fn;
+  std::vector<ZSetJob> batch; // being filled by the parser
+  std::size_t batchMembers = 0;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<std::vector<ZSetJob>> todo; // handed over, not built yet
+  std::deque<std::vector<ZSetJob>> done; // built, not delivered yet
+  bool closed = false;
+  std::atomic<bool> bad = false;
+  std::vector<std::jthread> workers; // last, they start in the constructor
+};
+
+// reads the value of a key into a new entry, or hands a sorted set over to
+// the decoder and returns nullptr
+auto readEntry(SnapshotReader &reader, Record record, std::string_view key,
+               std::int64_t expireAt, ZSetDecoder &decoder) -> Entry * {
+  auto *entry = Entry::create(key);
+  try {
+    switch (record) {
+    case Record::STR:
+      entry->setString(reader.getString());
+      return entry;
+    case Record::INT:
+      entry->setInteger(reader.get<std::int64_t>());
+      return entry;
+    case Record::ZSET: {
+      entry->setZSet();
+      ZSetJob job{.entry = entry, .expireAt = expireAt};
+      job.count = reader.get<std::uint32_t>();
+      job.members = reader.take(0);
+      for (auto count = job.count; count > 0; --count) {
+        reader.take(sizeof(std::double_t));
+        reader.getString();
+      }
+      decoder.add(job);
+      return nullptr;
+    }
+    default:
+      throw std::runtime_error("Bad snapshot record");
+    }
+  } catch (...) {
+    Entry::destroy(entry);
+    throw;
+  }
+}
+
+} // namespace
+
+namespace snapshot {
+
+auto save(const std::string &path, std::uint64_t keys,
+          const std::function<void(SnapshotWriter &)> &fn) -> bool {
+  auto temp = path + ".tmp." + std::to_string(getpid());
+  int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  SnapshotWriter writer(fd, keys);
+  fn(writer);
+  bool ok = writer.finish() && ::fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+    ::unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+auto load(const std::string &path,
+          const std::function<void(std::uint64_t)> &reserve,
+          const std::function<void(Entry *, std::int64_t)> &fn)
+    -> std::uint64_t {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return 0; // nothing saved yet
+    }
+    throw std::runtime_error("Failed to open snapshot " + path);
+  }
+  Mapping mapping(fd);
+  SnapshotReader reader(mapping.data, mapping.size);
+  auto magic = reader.take(SNAPSHOT_MAGIC.size());
+  if (std::string_view(magic, SNAPSHOT_MAGIC.size()) != SNAPSHOT_MAGIC ||
+      reader.get<std::uint32_t>() != SNAPSHOT_VERSION) {
+    throw std::runtime_error("Not a snapshot");
+  }
+  // every record takes SNAPSHOT_MIN_RECORD bytes at least, and END follows
+  auto keys = reader.get<std::uint64_t>();
+  if (reader.left() < 1 || keys > (reader.left() - 1) / SNAPSHOT_MIN_RECORD) {
+    throw std::runtime_error("Bad snapshot key count");
+  }
+  try {
+    reserve(keys);
+  } catch (const std::bad_alloc &) {
+    throw std::runtime_error("No memory for the keys of the snapshot");
+  }
+
+  auto cores = std::thread::hardware_concurrency();
+  ZSetDecoder decoder(
+      std::min<std::size_t>(cores > 1 ? cores - 1 : 0, SNAPSHOT_LOAD_THREADS),
+      fn);
+  std::uint64_t loaded = 0;
+  for (auto record = reader.get<Record>(); record != Record::END;
+       record = reader.get<Record>()) {
+    auto expireAt = reader.get<std::int64_t>();
+    auto key = reader.getString();
+    if (auto *entry = readEntry(reader, record, key, expireAt, decoder)) {
+      fn(entry, expireAt);
+    }
+    loaded++;
+  }
+  decoder.finish();
+  if (loaded != keys) {
+    throw std::runtime_error("Snapshot key count mismatch");
+  }
+  return loaded;
+}
+
+} // namespace snapshot
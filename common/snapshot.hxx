@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "entry.hxx"
+
+constexpr std::string_view SNAPSHOT_MAGIC = "COXXSNAP";
+constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+constexpr std::size_t SNAPSHOT_BUFFER_SIZE = 1 << 20;   // bytes per write
+constexpr std::size_t SNAPSHOT_LOAD_THREADS = 8;        // sorted set builders
+constexpr std::size_t SNAPSHOT_BATCH_MEMBERS = 1 << 16; // per hand over
+// the least bytes of a record: type, deadline, key size and value size
+constexpr std::size_t SNAPSHOT_MIN_RECORD = 1 + 8 + 4 + 4;
+
+/**
+ * @enum Record
+ * @brief The byte in front of every key of a snapshot, the type of its value.
+ *
+ */
+enum class Record : std::uint8_t {
+  STR = 0,
+  INT = 1,
+  ZSET = 2,
+  END = 0xFF, /** After the last key */
+};
+
+/**
+ * @class SnapshotWriter
+ * @brief Streams keys to a file in the snapshot format.
+ *
+ * Every number is little endian, and every string a u32 length and its bytes:
+ *
+ *     "COXXSNAP" u32 version, u64 keys
+ *     per key:   u8 record, i64 expiry in unix ms or 0, string key, then
+ *                STR a string, INT an i64, ZSET a u32 count and that many
+ *                f64 score, string name in (score, name) order
+ *     u8 END
+ *
+ * Writes go through a SNAPSHOT_BUFFER_SIZE buffer, so a key costs a copy and
+ * the file sees few, large writes.
+ */
+class SnapshotWriter {
+public:
+  /**
+   * @brief Writes the header.
+   *
+   * @param fd The file, written from its current offset.
+   * @param keys How many keys follow.
+   */
+  SnapshotWriter(int fd, std::uint64_t keys);
+
+  /**
+   * @brief Writes one key.
+   *
+   * @param entry The key and its value.
+   * @param expireAt When the key expires, in unix milliseconds, 0 if never.
+   */
+  void add(const Entry &entry, std::int64_t expireAt);
+
+  /**
+   * @brief Writes the end marker and whatever is still buffered.
+   *
+   * @return false if any write failed.
+   */
+  auto finish() -> bool;
+
+private:
+  void put(const void *data, std::size_t size);
+  void putString(std::string_view s);
+  void flush();
+
+  int fd;
+  std::unique_ptr<char[]> buffer;
+  std::size_t used = 0;
+  bool ok = true;
+};
+
+namespace snapshot {
+
+/**
+ * @brief Writes a snapshot, atomically replacing @p path.
+ *
+ * The keys go to a temporary file next to @p path, which is synced and
+ * renamed over it, so a crash leaves either snapshot whole.
+ *
+ * @param path The snapshot file.
+ * @param keys How many keys @p fn adds.
+ * @param fn Adds the keys to the writer.
+ * @return false if the file could not be written.
+ */
+auto save(const std::string &path, std::uint64_t keys,
+          const std::function<void(SnapshotWriter &)> &fn) -> bool;
+
+/**
+ * @brief Reads a snapshot, one key at a time.
+ *
+ * The file is mapped and parsed in place. Sorted sets are handed to up to
+ * SNAPSHOT_LOAD_THREADS threads in batches of about SNAPSHOT_BATCH_MEMBERS
+ * members, each set built in one pass from its sorted members, so they reach
+ * @p fn later than the keys around them. Both callbacks run on the calling
+ * thread.
+ *
+ * @param path The snapshot file.
+ * @param reserve Called with the number of keys in the header, before any.
+ * @param fn Called with every key, in a new entry that it takes over, and when
+ * the key expires in unix milliseconds, 0 if never.
+ * @return how many keys were read, 0 if there is no file.
+ * @throws std::runtime_error If the file is not a whole snapshot.
+ */
+auto load(const std::string &path,
+          const std::function<void(std::uint64_t)> &reserve,
+          const std::function<void(Entry *, std::int64_t)> &fn)
+    -> std::uint64_t;
+
+} // namespace snapshot
@@ -51,6 +51,23 @@ void Socket::setOptions() const {
   }
 }
 
+/**
+ * @brief Allows several sockets to bind the same address and port.
+ *
+ * With SO_REUSEPORT every listening socket bound to the port gets its own
+ * accept queue and the kernel load balances incoming connections between them,
+ * so each reactor thread can own a listener without sharing any state.
+ *
+ * @throws std::runtime_error IF setting the socket option fails.
+ */
+void Socket::setReusePort() const {
+  constexpr std::int64_t val = 1;
+  if (setsockopt(_fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) == -1)
+      [[unlikely]] {
+    throw std::runtime_error("Failed to set socket options");
+  }
+}
+
 /**
  * @brief Bind/Connect the Socket to a specified network address and port.
  *
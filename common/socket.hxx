@@ -27,6 +27,13 @@ public:
    */
   void setOptions() const;
 
+  /**
+   * @brief Allows several sockets to bind the same address and port.
+   *
+   * @throws std::runtime_error IF setting the socket option fails.
+   */
+  void setReusePort() const;
+
   /**
    * @brief Bind/Connect the Socket to a specified network address and port.
    *
@@ -0,0 +1,96 @@
+#include "hash.hxx"
+
+#include <array>
+#include <cstring>
+#include <random>
+
+// wyhash (final version 4, public domain), reads the input 8 bytes at a time
+constexpr std::array<std::uint64_t, 4> SECRET = {
+    0x2d358dccaa6c78a5, 0x8bb84b93962eacc9, 0x4b33a62ed433d4a3,
+    0x4d5a2da51de1aa47};
+
+static auto randomSeed() -> std::uint64_t {
+  std::random_device device;
+  return static_cast<std::uint64_t>(device()) << 32 | device();
+}
+
+static const std::uint64_t SEED = randomSeed();
+
+// 64x64 -> 128 bit multiply, the low half goes to a and the high half to b
+static inline void multiply(std::uint64_t &a, std::uint64_t &b) {
+  auto product = static_cast<unsigned __int128>(a) * b;
+  a = static_cast<std::uint64_t>(product);
+  b = static_cast<std::uint64_t>(product >> 64);
+}
+
+static inline auto mix(std::uint64_t a, std::uint64_t b) -> std::uint64_t {
+  multiply(a, b);
+  return a ^ b;
+}
+
+static inline auto read8(const std::uint8_t *p) -> std::uint64_t {
+  std::uint64_t v = 0;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+static inline auto read4(const std::uint8_t *p) -> std::uint64_t {
+  std::uint32_t v = 0;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+// 1 to 3 bytes
+static inline auto read3(const std::uint8_t *p, std::size_t k)
+    -> std::uint64_t {
+  return static_cast<std::uint64_t>(p[0]) << 16 |
+         static_cast<std::uint64_t>(p[k >> 1]) << 8 | p[k - 1];
+}
+
+auto stringHash(std::string_view data, std::uint64_t seed) -> std::uint64_t {
+  const auto *p = reinterpret_cast<const std::uint8_t *>(data.data());
+  std::size_t len = data.size();
+  seed ^= mix(seed ^ SECRET[0], SECRET[1]);
+
+  std::uint64_t a = 0;
+  std::uint64_t b = 0;
+  if (len <= 16) [[likely]] {
+    if (len >= 4) [[likely]] {
+      a = (read4(p) << 32) | read4(p + ((len >> 3) << 2));
+      b = (read4(p + len - 4) << 32) | read4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = read3(p, len);
+    }
+  } else {
+    std::size_t i = len;
+    if (i > 48) [[unlikely]] {
+      // three independent lanes
+      std::uint64_t seed1 = seed;
+      std::uint64_t seed2 = seed;
+      do {
+        seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+        seed1 = mix(read8(p + 16) ^ SECRET[2], read8(p + 24) ^ seed1);
+        seed2 = mix(read8(p + 32) ^ SECRET[3], read8(p + 40) ^ seed2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (i > 16) {
+      seed = mix(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = read8(p + i - 16);
+    b = read8(p + i - 8);
+  }
+
+  a ^= SECRET[1];
+  b ^= seed;
+  multiply(a, b);
+  return mix(a ^ SECRET[0] ^ len, b ^ SECRET[1]);
+}
+
+auto stringHash(std::string_view data) -> std::uint64_t {
+  return stringHash(data, SEED);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Hashes a string with the seed of this process.
+ *
+ * The seed is drawn at random on start up, so which keys collide cannot be
+ * known from outside and a client cannot flood one bucket on purpose.
+ *
+ * @param data The bytes to hash.
+ * @return a 64 bit hash, every bit is usable.
+ */
+auto stringHash(std::string_view data) -> std::uint64_t;
+
+/**
+ * @brief Hashes a string with the given seed.
+ *
+ * @param data The bytes to hash.
+ * @param seed The seed, the same seed always gives the same hash.
+ * @return a 64 bit hash, every bit is usable.
+ */
+auto stringHash(std::string_view data, std::uint64_t seed) -> std::uint64_t;
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include <bit>
+#include <string>
+#include <unordered_set>
+
+#include "hash/hash.hxx"
+
+constexpr std::size_t MAX_LENGTH = 300;
+constexpr std::uint64_t TEST_SEED = 42;
+
+TEST(HashTest, SameInputSameHash) {
+  std::string key = "some key";
+  ASSERT_EQ(stringHash(key), stringHash(std::string(key)));
+  ASSERT_EQ(stringHash(key, TEST_SEED), stringHash(key, TEST_SEED));
+}
+
+TEST(HashTest, EveryLengthIsHashed) {
+  // covers every read path, a byte more or less changes the hash
+  std::string key;
+  std::unordered_set<std::uint64_t> hashes;
+  for (std::size_t len = 0; len <= MAX_LENGTH; ++len) {
+    ASSERT_TRUE(hashes.insert(stringHash(key, TEST_SEED)).second) << len;
+    key.push_back('\0');
+  }
+}
+
+TEST(HashTest, EveryByteIsHashed) {
+  for (std::size_t len = 1; len <= MAX_LENGTH; ++len) {
+    std::string key(len, 'k');
+    auto hash = stringHash(key, TEST_SEED);
+    for (std::size_t i = 0; i < len; ++i) {
+      key[i] ^= 1;
+      ASSERT_NE(stringHash(key, TEST_SEED), hash) << len << " " << i;
+      key[i] ^= 1;
+    }
+  }
+}
+
+TEST(HashTest, SeedChangesTheHash) {
+  std::string key = "some key";
+  ASSERT_NE(stringHash(key, TEST_SEED), stringHash(key, TEST_SEED + 1));
+}
+
+TEST(HashTest, HighBitsAreMixed) {
+  // keys that differ in one byte differ in about half of the top 32 bits
+  std::size_t flipped = 0;
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < 1000; ++i) {
+    auto a = stringHash("key:" + std::to_string(i), TEST_SEED);
+    auto b = stringHash("key:" + std::to_string(i + 1), TEST_SEED);
+    flipped += std::popcount((a ^ b) >> 32);
+    n += 32;
+  }
+  ASSERT_NEAR(static_cast<double>(flipped) / static_cast<double>(n), 0.5, 0.05);
+}
@@ -0,0 +1,581 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @struct HashNode
+ * @brief The member an object needs to be stored in an IntrusiveHashMap.
+ *
+ */
+struct HashNode {
+  std::uint64_t code = 0; /** The hash of the object, set on insertion */
+};
+
+namespace intrusive {
+
+constexpr std::size_t GROUP_SIZE = 16;
+constexpr std::size_t RESIZING_WORK = 128; // constant work
+constexpr std::size_t MIN_SLOTS = 2 * GROUP_SIZE;
+
+// control bytes, a full slot holds 0x80 | its 7 bit tag instead. Empty is 0
+// so a fresh table comes from calloc without touching its pages.
+constexpr std::int8_t EMPTY = 0;
+constexpr std::int8_t DELETED = 1;
+
+inline auto tag(std::uint64_t code) -> std::int8_t {
+  return static_cast<std::int8_t>(0x80 | (code & 0x7F));
+}
+
+// bit i is set if control byte i of the group equals `byte`
+inline auto match(const std::int8_t *group, std::int8_t byte)
+    -> std::uint32_t {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+  __m128i bytes = _mm_set1_epi8(byte);
+  return static_cast<std::uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, bytes)));
+#else
+  std::uint32_t mask = 0;
+  for (std::uint32_t i = 0; i < GROUP_SIZE; ++i) {
+    mask |= static_cast<std::uint32_t>(group[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+// bit i is set if slot i of the group is full
+inline auto matchFull(const std::int8_t *group) -> std::uint32_t {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+  return static_cast<std::uint32_t>(_mm_movemask_epi8(ctrl)); // the high bits
+#else
+  std::uint32_t mask = 0;
+  for (std::uint32_t i = 0; i < GROUP_SIZE; ++i) {
+    mask |= static_cast<std::uint32_t>(group[i] < 0) << i;
+  }
+  return mask;
+#endif
+}
+
+// bit i is set if slot i of the group is empty or deleted
+inline auto matchFree(const std::int8_t *group) -> std::uint32_t {
+  return ~matchFull(group) & ((1U << GROUP_SIZE) - 1);
+}
+
+} // namespace intrusive
+
+/**
+ * @class IntrusiveHashMap
+ * @brief An open addressing hash map of objects that embed a HashNode.
+ *
+ * The map stores pointers to the objects and never allocates or frees them.
+ * Slots come in groups of 16, every slot has a control byte that is empty,
+ * deleted, or the low 7 bits of the hash with the high bit set. A probe checks
+ * the control bytes of a whole group with one SIMD compare.
+ *
+ * Hashing and comparison are template parameters, so both inline into the
+ * probe loop. `Hash` is called with an object or with a key, `Eq` with an
+ * object and a key.
+ *
+ * Resizing is incremental: a resize allocates a table sized for the nodes
+ * and every operation moves a few of them over, or `rehash()` does when the
+ * owner is idle. A table grows at 7/8 full and shrinks below 1/8. The new
+ * table has room for every insert that can come before the old one is empty,
+ * so no operation ever has to finish a resize.
+ *
+ * @tparam T The type of the stored objects.
+ * @tparam Member The HashNode member of T.
+ * @tparam Hash Hashes a `const T &` or a key to a 64 bit hash.
+ * @tparam Eq Compares a `const T &` to a key.
+ */
+template <typename T, HashNode T::*Member, typename Hash, typename Eq>
+class IntrusiveHashMap {
+public:
+  IntrusiveHashMap() = default;
+
+  /**
+   * @brief Destroy the IntrusiveHashMap object
+   *
+   * Frees the tables, the objects belong to the caller.
+   */
+  ~IntrusiveHashMap() {
+    release(table1);
+    release(table2);
+  }
+
+  IntrusiveHashMap(const IntrusiveHashMap &) = delete;
+  auto operator=(const IntrusiveHashMap &) -> IntrusiveHashMap & = delete;
+
+  /**
+   * @brief Finds the object stored under @p key.
+   *
+   * @param key The key, anything `Hash` and `Eq` take.
+   * @param code The hash of the key, when the caller already has it.
+   * @return the object, or nullptr if there is none.
+   */
+  template <typename K> auto find(const K &key) -> T * {
+    return find(key, Hash{}(key));
+  }
+  template <typename K> auto find(const K &key, std::uint64_t code) -> T * {
+    helpResizing();
+    auto *slot = lookUp(table1, key, code);
+    slot = slot ? slot : lookUp(table2, key, code);
+    return slot ? *slot : nullptr;
+  }
+
+  /**
+   * @brief Starts loading the first probe group of @p code.
+   *
+   * For batches of lookups: prefetch every key first, then call
+   * `prefetchMatches()` for every key, then `find()`, so the cache misses of
+   * the batch overlap instead of coming one after the other.
+   *
+   * @param code The hash of a key that is looked up soon.
+   */
+  void prefetch(std::uint64_t code) const {
+    for (const auto *table : {&table1, &table2}) {
+      if (table->slots) {
+        std::size_t index = firstGroup(*table, code) * intrusive::GROUP_SIZE;
+        __builtin_prefetch(table->ctrl + index);
+        __builtin_prefetch(table->slots + index); // 16 pointers, 2 lines
+        __builtin_prefetch(table->slots + index + intrusive::GROUP_SIZE / 2);
+      }
+    }
+  }
+
+  /**
+   * @brief Starts loading the objects in the first probe group of @p code
+   * whose tag matches, after `prefetch()` brought the group in.
+   *
+   * @param code The hash of a key that is looked up soon.
+   */
+  void prefetchMatches(std::uint64_t code) const {
+    auto h2 = intrusive::tag(code);
+    for (const auto *table : {&table1, &table2}) {
+      if (table->slots) {
+        std::size_t index = firstGroup(*table, code) * intrusive::GROUP_SIZE;
+        for (auto m = intrusive::match(table->ctrl + index, h2); m;
+             m &= m - 1) {
+          __builtin_prefetch(table->slots[index + std::countr_zero(m)]);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Stores @p item, which must not be in the map yet.
+   *
+   * @param item The object, it stays owned by the caller.
+   * @param code The hash of the object, when the caller already has it.
+   * @throws std::bad_alloc If a resize can not allocate its table.
+   */
+  void insert(T *item) { insert(item, Hash{}(std::as_const(*item))); }
+  void insert(T *item, std::uint64_t code) {
+    (item->*Member).code = code;
+    if (!table1.slots) {
+      initialize(table1, intrusive::MIN_SLOTS);
+    }
+
+    place(table1, item);
+
+    // a resize in progress always ends before its table fills up
+    if (!table2.slots && table1.size + table1.deleted >= maxLoad(table1)) {
+      startResizing();
+    }
+    helpResizing();
+  }
+
+  /**
+   * @brief Sizes the table for @p count objects, so that storing them does no
+   * resize step along the way.
+   *
+   * During a resize, the next one sizes the table for them instead.
+   *
+   * @param count How many objects the map holds soon.
+   * @throws std::bad_alloc If the table can not be allocated.
+   */
+  void reserve(std::size_t count) {
+    if (!count || count < maxLoad(table1)) {
+      return;
+    }
+    // the table growing would end up with, not the half full one of a resize
+    std::size_t n = intrusive::MIN_SLOTS;
+    while (n / 8 * 7 <= count) {
+      n *= 2;
+    }
+    if (table2.slots) {
+      reserved = std::max(reserved, n);
+      return;
+    }
+    if (!table1.size && !table1.deleted) {
+      release(table1);
+      initialize(table1, n);
+      return;
+    }
+    startResizing(n); // moved over as usual
+  }
+
+  /**
+   * @brief Removes the object stored under @p key.
+   *
+   * @param key The key, anything `Hash` and `Eq` take.
+   * @param code The hash of the key, when the caller already has it.
+   * @return the removed object, or nullptr if there was none.
+   */
+  template <typename K> auto pop(const K &key) -> T * {
+    return pop(key, Hash{}(key));
+  }
+  template <typename K> auto pop(const K &key, std::uint64_t code) -> T * {
+    helpResizing();
+    T *item = nullptr;
+    if (auto *slot = lookUp(table1, key, code)) {
+      item = detach(table1, slot);
+    } else if ((slot = lookUp(table2, key, code))) {
+      item = detach(table2, slot);
+    }
+
+    if (item) {
+      shrinkIfSparse();
+    }
+    return item;
+  }
+
+  /**
+   * @brief Get the number of stored objects.
+   *
+   * @return the number of objects in both tables.
+   */
+  auto size() const -> std::size_t { return table1.size + table2.size; }
+
+  /** The resize work done so far, one per object moved and per group left. */
+  auto resizeWork() const -> std::size_t { return resized; }
+
+  /** The bytes of the tables, the objects are not counted. */
+  auto memory() const -> std::size_t {
+    std::size_t slots = 0;
+    for (const auto *table : {&table1, &table2}) {
+      slots += table->slots ? table->mask + 1 : 0;
+    }
+    return slots * (sizeof(std::int8_t) + sizeof(T *));
+  }
+
+  /**
+   * @brief Calls @p fn with some stored objects, picked at random.
+   *
+   * Starts at a random slot, of either table when resizing, and takes the
+   * objects from there on until it has @p count. Objects after long runs of
+   * free slots are picked more often, which is fine for sampling.
+   *
+   * @param random A uniformly random number that picks the first slot.
+   * @param count The most objects to take.
+   * @param fn Called with a `T &`, it must not change the map.
+   * @return how many objects were taken.
+   */
+  template <typename Fn>
+  auto sample(std::uint64_t random, std::size_t count, Fn &&fn) const
+      -> std::size_t {
+    const Table *table = &table1;
+    if (table2.size && random % size() >= table1.size) {
+      table = &table2;
+    }
+    if (!table->size) {
+      return 0;
+    }
+
+    // from a random slot on, the slots before it in its group come last
+    std::size_t start = (random >> 32) & table->mask;
+    std::size_t first = start & ~(intrusive::GROUP_SIZE - 1);
+    std::uint32_t after = ~0U << (start - first);
+    std::size_t taken = 0;
+    for (std::size_t i = 0; i <= table->mask + 1 && taken < count;
+         i += intrusive::GROUP_SIZE) {
+      std::size_t index = (first + i) & table->mask;
+      auto full = intrusive::matchFull(table->ctrl + index);
+      full &= i == 0 ? after : i > table->mask ? ~after : ~0U;
+      for (; full && taken < count; full &= full - 1) {
+        fn(*table->slots[index + std::countr_zero(full)]);
+        taken++;
+      }
+    }
+    return taken;
+  }
+
+  /**
+   * @brief Does one step of a pending resize, for when the owner is idle.
+   *
+   * @return true while there is more to do.
+   */
+  auto rehash() -> bool {
+    helpResizing();
+    shrinkIfSparse(); // pops that came during a resize could not start it
+    return table2.slots != nullptr;
+  }
+
+  /**
+   * @brief Calls @p fn with every stored object.
+   *
+   * @param fn Called with a `T &`, it must not change the map.
+   */
+  template <typename Fn> void forEach(Fn &&fn) const {
+    for (const auto *table : {&table1, &table2}) {
+      for (std::size_t i = 0; table->slots && i <= table->mask; ++i) {
+        if (table->ctrl[i] < 0) { // full
+          fn(*table->slots[i]);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Calls @p fn with the objects of the home groups under @p cursor.
+   *
+   * The cursor counts home groups in reverse binary order, so when the table
+   * grows or shrinks between calls the groups visited so far map onto groups
+   * the cursor has already passed. Every object stored during the whole walk
+   * is visited at least once, some may be visited twice. While resizing, the
+   * group of the smaller table and every group of the larger one it expands
+   * into are visited in the same call.
+   *
+   * @param cursor 0 to start a walk, then the value returned by the last call.
+   * @param fn Called with a `T &`, it must not change the map.
+   * @return the cursor of the next call, 0 once the walk is over.
+   */
+  template <typename Fn>
+  auto scan(std::size_t cursor, Fn &&fn) const -> std::size_t {
+    const Table *small = &table1;
+    const Table *large = &table2;
+    if (!small->slots || (large->slots && large->mask < small->mask)) {
+      std::swap(small, large);
+    }
+    if (!small->slots) {
+      return 0;
+    }
+
+    std::size_t smallMask = small->mask / intrusive::GROUP_SIZE;
+    scanGroup(*small, cursor & smallMask, fn);
+    if (large->slots) {
+      // the groups of the larger table whose low bits are the cursor
+      std::size_t largeMask = large->mask / intrusive::GROUP_SIZE;
+      do {
+        scanGroup(*large, cursor & largeMask, fn);
+        cursor = (((cursor | smallMask) + 1) & ~smallMask) |
+                 (cursor & smallMask);
+      } while (cursor & (smallMask ^ largeMask));
+    }
+
+    // increment the reversed cursor
+    cursor |= ~smallMask;
+    cursor = reverseBits(reverseBits(cursor) + 1);
+    return cursor;
+  }
+
+  /**
+   * @brief Forgets every object and frees the tables.
+   *
+   */
+  void clear() {
+    release(table1);
+    release(table2);
+    resizingPosition = 0;
+    reserved = 0;
+  }
+
+private:
+  struct Table {
+    std::int8_t *ctrl = nullptr; // one control byte per slot
+    T **slots = nullptr;
+    std::size_t mask = 0;    // number of slots - 1
+    std::size_t size = 0;    // full slots
+    std::size_t deleted = 0; // tombstones
+  };
+
+  static void initialize(Table &table, std::size_t n) {
+    assert(n >= intrusive::GROUP_SIZE && std::has_single_bit(n));
+    table.ctrl = static_cast<std::int8_t *>(std::calloc(n, 1));
+    table.slots = static_cast<T **>(std::malloc(n * sizeof(T *)));
+    if (!table.ctrl || !table.slots) {
+      std::free(table.ctrl);
+      std::free(table.slots);
+      table = Table{};
+      throw std::bad_alloc();
+    }
+    table.mask = n - 1;
+    table.size = 0;
+    table.deleted = 0;
+  }
+
+  static void release(Table &table) {
+    std::free(table.ctrl);
+    std::free(table.slots);
+    table = Table{};
+  }
+
+  // keep 1/8 of the slots empty, so every probe ends
+  static auto maxLoad(const Table &table) -> std::size_t {
+    return (table.mask + 1) / 8 * 7;
+  }
+
+  // the table for `size` objects, at most half full, with room for the
+  // inserts that come while RESIZING_WORK at a time moves `from` over
+  static auto capacityFor(std::size_t size, const Table &from) -> std::size_t {
+    std::size_t work = from.size + (from.mask + 1) / intrusive::GROUP_SIZE;
+    std::size_t n = intrusive::MIN_SLOTS;
+    while (n / 2 < size || (n / 8 * 7 - size) * intrusive::RESIZING_WORK <
+                               work + intrusive::RESIZING_WORK) {
+      n *= 2;
+    }
+    return n;
+  }
+
+  // groups are probed in triangular steps, which visits every group
+  static auto firstGroup(const Table &table, std::uint64_t code)
+      -> std::size_t {
+    return (code >> 7) & (table.mask / intrusive::GROUP_SIZE);
+  }
+
+  static auto nextGroup(const Table &table, std::size_t group,
+                        std::size_t step) -> std::size_t {
+    return (group + step) & (table.mask / intrusive::GROUP_SIZE);
+  }
+
+  static void place(Table &table, T *item) {
+    std::uint64_t code = (item->*Member).code;
+    std::size_t group = firstGroup(table, code);
+    for (std::size_t step = 1;; ++step) {
+      auto free =
+          intrusive::matchFree(table.ctrl + group * intrusive::GROUP_SIZE);
+      if (free) {
+        std::size_t index =
+            group * intrusive::GROUP_SIZE + std::countr_zero(free);
+        table.deleted -= table.ctrl[index] == intrusive::DELETED;
+        table.ctrl[index] = intrusive::tag(code);
+        table.slots[index] = item;
+        table.size++;
+        return;
+      }
+      group = nextGroup(table, group, step);
+    }
+  }
+
+  template <typename K>
+  static auto lookUp(Table &table, const K &key, std::uint64_t code) -> T ** {
+    if (!table.slots) {
+      return nullptr;
+    }
+
+    auto h2 = intrusive::tag(code);
+    std::size_t group = firstGroup(table, code);
+    for (std::size_t step = 1;; ++step) {
+      const auto *ctrl = table.ctrl + group * intrusive::GROUP_SIZE;
+      for (auto m = intrusive::match(ctrl, h2); m; m &= m - 1) {
+        auto **slot =
+            &table.slots[group * intrusive::GROUP_SIZE + std::countr_zero(m)];
+        if (((*slot)->*Member).code == code && Eq{}(std::as_const(**slot), key))
+            [[likely]] {
+          return slot;
+        }
+      }
+      if (intrusive::match(ctrl, intrusive::EMPTY)) {
+        return nullptr; // the probe never went past this group
+      }
+      group = nextGroup(table, group, step);
+    }
+  }
+
+  // the objects whose probe starts at `home` are on its probe sequence, up to
+  // the first group with an empty slot
+  template <typename Fn>
+  static void scanGroup(const Table &table, std::size_t home, Fn &fn) {
+    std::size_t group = home;
+    for (std::size_t step = 1;; ++step) {
+      const auto *ctrl = table.ctrl + group * intrusive::GROUP_SIZE;
+      for (auto full = intrusive::matchFull(ctrl); full; full &= full - 1) {
+        auto *item =
+            table.slots[group * intrusive::GROUP_SIZE + std::countr_zero(full)];
+        if (firstGroup(table, (item->*Member).code) == home) {
+          fn(*item);
+        }
+      }
+      if (intrusive::match(ctrl, intrusive::EMPTY)) {
+        return;
+      }
+      group = nextGroup(table, group, step);
+    }
+  }
+
+  static auto reverseBits(std::uint64_t v) -> std::uint64_t {
+    v = ((v >> 1) & 0x5555555555555555) | ((v & 0x5555555555555555) << 1);
+    v = ((v >> 2) & 0x3333333333333333) | ((v & 0x3333333333333333) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0F) | ((v & 0x0F0F0F0F0F0F0F0F) << 4);
+    return std::byteswap(v);
+  }
+
+  static auto detach(Table &table, T **slot) -> T * {
+    auto index = static_cast<std::size_t>(slot - table.slots);
+    const auto *group =
+        table.ctrl + (index & ~(intrusive::GROUP_SIZE - 1));
+    if (intrusive::match(group, intrusive::EMPTY)) {
+      table.ctrl[index] = intrusive::EMPTY; // no probe goes past this group
+    } else {
+      table.ctrl[index] = intrusive::DELETED; // keep the probes going
+      table.deleted++;
+    }
+    table.size--;
+    return *slot;
+  }
+
+  void helpResizing() {
+    std::size_t work = 0;
+    while (work < intrusive::RESIZING_WORK && table2.size > 0) {
+      // move the objects of one group of the second table to the first
+      std::size_t position = resizingPosition;
+      for (auto full = intrusive::matchFull(table2.ctrl + position); full;
+           full &= full - 1) {
+        std::size_t index = position + std::countr_zero(full);
+        place(table1, detach(table2, &table2.slots[index]));
+        work++;
+      }
+      resizingPosition += intrusive::GROUP_SIZE;
+      work++;
+    }
+    resized += work;
+
+    if (table2.size == 0 && table2.slots) {
+      release(table2);
+    }
+  }
+
+  // grows a full table, drops the tombstones of a table full of them, and
+  // shrinks a sparse one
+  void startResizing(std::size_t n = 0) {
+    assert(!table2.slots);
+    n = std::max({n, std::exchange(reserved, 0),
+                  capacityFor(table1.size, table1)});
+    Table fresh;
+    initialize(fresh, n); // the map stays as it is if this throws
+    table2 = std::exchange(table1, fresh);
+    resizingPosition = 0;
+  }
+
+  void shrinkIfSparse() {
+    std::size_t n = table1.mask + 1;
+    if (!table2.slots && n > intrusive::MIN_SLOTS && table1.size < n / 8) {
+      startResizing();
+    }
+  }
+
+  Table table1; // receives the inserts
+  Table table2; // being moved into table1 while resizing
+  std::size_t resizingPosition = 0;
+  std::size_t reserved = 0; // slots of a reserve() that came during a resize
+  std::size_t resized = 0;  // work of every resize so far
+};
@@ -0,0 +1,251 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "intrusive.hxx"
+
+constexpr std::size_t MANY_KEYS = 100000;
+
+struct Item {
+  std::uint64_t key = 0;
+  HashNode node;
+};
+
+struct ItemHash {
+  auto operator()(const Item &item) const { return (*this)(item.key); }
+  auto operator()(std::uint64_t key) const -> std::uint64_t {
+    return key * 0x9E3779B97F4A7C15;
+  }
+};
+
+struct ItemEq {
+  auto operator()(const Item &item, std::uint64_t key) const {
+    return item.key == key;
+  }
+};
+
+// every key has the same hash, only the equality tells them apart
+struct CollidingHash {
+  auto operator()(const Item &) const -> std::uint64_t { return 42; }
+  auto operator()(std::uint64_t) const -> std::uint64_t { return 42; }
+};
+
+using ItemMap = IntrusiveHashMap<Item, &Item::node, ItemHash, ItemEq>;
+
+TEST(IntrusiveHashMapTest, InsertFindAndPopTest) {
+  ItemMap map;
+  Item item1 = {.key = 1};
+  Item item2 = {.key = 2};
+
+  map.insert(&item1);
+  map.insert(&item2);
+  ASSERT_EQ(map.size(), 2);
+
+  ASSERT_EQ(map.find(1UL), &item1);
+  ASSERT_EQ(map.find(2UL), &item2);
+  ASSERT_EQ(map.find(3UL), nullptr);
+
+  ASSERT_EQ(map.pop(1UL), &item1);
+  ASSERT_EQ(map.pop(1UL), nullptr);
+  ASSERT_EQ(map.find(1UL), nullptr);
+  ASSERT_EQ(map.find(2UL), &item2);
+  ASSERT_EQ(map.size(), 1);
+}
+
+TEST(IntrusiveHashMapTest, EqualHashesTest) {
+  IntrusiveHashMap<Item, &Item::node, CollidingHash, ItemEq> map;
+  std::vector<Item> items(3 * intrusive::GROUP_SIZE);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+    map.insert(&items[i]);
+  }
+
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    ASSERT_EQ(map.find(i), &items[i]);
+  }
+  ASSERT_EQ(map.find(items.size()), nullptr);
+}
+
+TEST(IntrusiveHashMapTest, ResizesIncrementallyTest) {
+  ItemMap map;
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+    map.insert(&items[i]);
+
+    // a resize moves only a few objects at a time, the rest stay reachable
+    ASSERT_EQ(map.find(i / 2), &items[i / 2]);
+  }
+  ASSERT_EQ(map.size(), items.size());
+
+  for (std::size_t i = 0; i < items.size(); i += 2) {
+    ASSERT_EQ(map.pop(i), &items[i]);
+  }
+  ASSERT_EQ(map.size(), items.size() / 2);
+
+  std::size_t visited = 0;
+  map.forEach([&visited](const Item &item) {
+    ASSERT_EQ(item.key % 2, 1);
+    visited++;
+  });
+  ASSERT_EQ(visited, items.size() / 2);
+}
+
+TEST(IntrusiveHashMapTest, ShrinksAndRehashesWhileIdleTest) {
+  ItemMap map;
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+    map.insert(&items[i]);
+  }
+  for (std::size_t i = intrusive::GROUP_SIZE; i < items.size(); ++i) {
+    ASSERT_EQ(map.pop(i), &items[i]);
+  }
+
+  while (map.rehash()) {
+  }
+  ASSERT_FALSE(map.rehash());
+
+  ASSERT_EQ(map.size(), intrusive::GROUP_SIZE);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    ASSERT_EQ(map.find(i), i < intrusive::GROUP_SIZE ? &items[i] : nullptr);
+  }
+}
+
+TEST(IntrusiveHashMapTest, ReserveSizesTheTableOnceTest) {
+  ItemMap map;
+  std::vector<Item> items(MANY_KEYS);
+  map.reserve(items.size());
+  auto reserved = map.memory();
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+    map.insert(&items[i]);
+    ASSERT_EQ(map.memory(), reserved); // no resize along the way
+  }
+
+  // a larger reserve moves the stored objects over like a resize
+  map.reserve(4 * items.size());
+  ASSERT_GT(map.memory(), reserved);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    ASSERT_EQ(map.find(i), &items[i]);
+  }
+  while (map.rehash()) {
+  }
+  ASSERT_EQ(map.size(), items.size());
+}
+
+TEST(IntrusiveHashMapTest, NoInsertFinishesAResizeTest) {
+  ItemMap map;
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+  }
+  for (std::size_t i = 0; i < 10; ++i) {
+    map.insert(&items[i]);
+  }
+
+  // a huge, nearly empty table, and then a shrink that has to go through it
+  map.reserve(1 << 20);
+  while (map.rehash()) {
+  }
+  map.pop(0UL);
+
+  // every insert does one step, of a group more than RESIZING_WORK at most
+  for (std::size_t i = 10; i < items.size(); ++i) {
+    auto before = map.resizeWork();
+    map.insert(&items[i]);
+    ASSERT_LE(map.resizeWork() - before,
+              intrusive::RESIZING_WORK + intrusive::GROUP_SIZE + 1);
+  }
+  for (std::size_t i = 1; i < items.size(); ++i) {
+    ASSERT_EQ(map.find(i), &items[i]);
+  }
+}
+
+TEST(IntrusiveHashMapTest, ScanVisitsEveryObjectOnceTest) {
+  ItemMap map;
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+    map.insert(&items[i]);
+  }
+  while (map.rehash()) {
+  }
+
+  // no resize during the walk, so nothing comes twice
+  std::vector<int> seen(items.size());
+  std::size_t cursor = 0;
+  do {
+    cursor = map.scan(cursor, [&seen](const Item &item) { seen[item.key]++; });
+  } while (cursor);
+  for (auto n : seen) {
+    ASSERT_EQ(n, 1);
+  }
+}
+
+TEST(IntrusiveHashMapTest, ScanSurvivesResizesTest) {
+  ItemMap map;
+  std::vector<Item> items(4 * MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+  }
+  for (std::size_t i = 0; i < MANY_KEYS; ++i) {
+    map.insert(&items[i]);
+  }
+
+  std::vector<int> seen(items.size());
+  auto visit = [&seen](const Item &item) { seen[item.key]++; };
+  std::size_t cursor = 0;
+  for (int i = 0; i < 100; ++i) {
+    cursor = map.scan(cursor, visit);
+  }
+
+  // the table grows twice, the walk goes on during the last resize
+  for (std::size_t i = MANY_KEYS; i < items.size(); ++i) {
+    map.insert(&items[i]);
+  }
+  for (int i = 0; i < 100; ++i) {
+    cursor = map.scan(cursor, visit);
+  }
+
+  // and shrinks back
+  for (std::size_t i = MANY_KEYS / 2; i < items.size(); ++i) {
+    map.pop(i);
+  }
+  do {
+    cursor = map.scan(cursor, visit);
+  } while (cursor);
+
+  // the objects that were there the whole time were all visited
+  for (std::size_t i = 0; i < MANY_KEYS / 2; ++i) {
+    ASSERT_GE(seen[i], 1);
+  }
+}
+
+TEST(IntrusiveHashMapTest, SampleReachesEveryObjectTest) {
+  ItemMap map;
+  std::vector<Item> items(MANY_KEYS);
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    items[i].key = i;
+    map.insert(&items[i]);
+  }
+
+  // random starting groups, some of them while the last resize goes on
+  std::vector<int> seen(items.size());
+  std::uint64_t random = 1;
+  for (std::size_t i = 0; i < 20 * MANY_KEYS / 5; ++i) {
+    random = random * 6364136223846793005 + 1442695040888963407;
+    auto taken = map.sample(random, 5, [&seen](const Item &item) {
+      seen[item.key]++;
+    });
+    ASSERT_EQ(taken, 5);
+    map.rehash();
+  }
+  for (auto n : seen) {
+    ASSERT_GE(n, 1);
+  }
+
+  ItemMap few;
+  few.insert(&items[0]);
+  ASSERT_EQ(few.sample(random, 5, [](const Item &) {}), 1);
+}
@@ -0,0 +1,102 @@
+#include "config.hxx"
+
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Parses an unsigned integer option value.
+ *
+ * @param name The option name, used in the error message.
+ * @param value The textual value.
+ * @return the parsed number.
+ * @throws std::invalid_argument If the value is not a number.
+ */
+static auto toNumber(std::string_view name, std::string_view value)
+    -> std::uint64_t {
+  std::uint64_t number = 0;
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), number);
+  if (ec != std::errc() || ptr != value.data() + value.size()) {
+    throw std::invalid_argument("Invalid value for " + std::string(name));
+  }
+  return number;
+}
+
+/**
+ * @brief Parses `--name value` pairs from the command line into a Config.
+ *
+ * Settings that are not given keep their default value.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return the parsed configuration.
+ * @throws std::invalid_argument If an option is unknown or has a bad value.
+ */
+auto parseConfig(int argc, char **argv) -> Config {
+  Config config;
+  for (int i = 1; i < argc; i += 2) {
+    std::string_view name = argv[i];
+    if (i + 1 >= argc) {
+      throw std::invalid_argument("Missing value for " + std::string(name));
+    }
+    std::string_view value = argv[i + 1];
+
+    if (name == "--reactors") {
+      config.reactors = toNumber(name, value);
+      if (config.reactors == 0) {
+        throw std::invalid_argument("Invalid value for --reactors");
+      }
+    } else if (name == "--max-message-size") {
+      config.maxMessageSize = toNumber(name, value);
+      if (config.maxMessageSize < 4 ||
+          config.maxMessageSize > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::invalid_argument("Invalid value for --max-message-size");
+      }
+    } else if (name == "--maxmemory") {
+      config.maxMemory = toNumber(name, value);
+    } else if (name == "--maxmemory-policy") {
+      if (value == "lru") {
+        config.eviction = Eviction::LRU;
+      } else if (value == "lfu") {
+        config.eviction = Eviction::LFU;
+      } else {
+        throw std::invalid_argument("Invalid value for --maxmemory-policy");
+      }
+    } else if (name == "--zset-max-pack-members") {
+      config.zsetPackMembers = toNumber(name, value);
+    } else if (name == "--zset-max-pack-name") {
+      config.zsetPackName = toNumber(name, value);
+      if (config.zsetPackName > ZSET_PACK_NAME_LIMIT) {
+        throw std::invalid_argument("Invalid value for --zset-max-pack-name");
+      }
+    } else if (name == "--snapshot") {
+      config.snapshot = value;
+    } else if (name == "--appendonly") {
+      config.appendOnly = value;
+    } else if (name == "--appendfsync") {
+      if (value == "always") {
+        config.appendFsync = Fsync::ALWAYS;
+      } else if (value == "everysec") {
+        config.appendFsync = Fsync::EVERYSEC;
+      } else if (value == "no") {
+        config.appendFsync = Fsync::NO;
+      } else {
+        throw std::invalid_argument("Invalid value for --appendfsync");
+      }
+    } else if (name == "--backend") {
+      if (value == "epoll") {
+        config.backend = Backend::EPOLL;
+      } else if (value == "uring") {
+        config.backend = Backend::URING;
+      } else {
+        throw std::invalid_argument("Invalid value for --backend");
+      }
+    } else [[unlikely]] {
+      throw std::invalid_argument("Unknown option " + std::string(name));
+    }
+  }
+  return config;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "common/req.hxx"
+
+/**
+ * @enum Backend
+ * @brief The I/O mechanism the reactors are built on.
+ *
+ */
+enum class Backend : std::uint8_t {
+  EPOLL = 0, /** epoll readiness + read()/write() */
+  URING = 1, /** io_uring completions */
+};
+
+/**
+ * @struct Config
+ * @brief Runtime settings of the server, filled in from the command line.
+ *
+ */
+struct Config {
+  std::size_t reactors = 1;         /** Number of event loop threads */
+  Backend backend = Backend::EPOLL; /** I/O backend of every reactor */
+  std::size_t maxMessageSize = MAX_MESSAGE_SIZE; /** Largest frame, in bytes */
+  std::size_t maxMemory = 0; /** Memory limit of the keys in bytes, 0 if none */
+  Eviction eviction = Eviction::LRU; /** Which keys go over the limit first */
+  std::size_t zsetPackMembers = ZSET_PACK_MEMBERS; /** Most members packed */
+  std::size_t zsetPackName = ZSET_PACK_NAME; /** Longest name packed */
+  std::string snapshot; /** File SAVE and BGSAVE write, empty for none */
+  std::string appendOnly; /** Log of the write commands, empty for none */
+  Fsync appendFsync = Fsync::EVERYSEC; /** When the log is synced */
+};
+
+/**
+ * @brief Parses `--name value` pairs from the command line into a Config.
+ *
+ * Settings that are not given keep their default value.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return the parsed configuration.
+ * @throws std::invalid_argument If an option is unknown or has a bad value.
+ */
+auto parseConfig(int argc, char **argv) -> Config;
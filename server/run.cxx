@@ -1,7 +1,7 @@
 #include "server.hxx"
 
-auto main() -> int {
-  Server server;
+auto main(int argc, char **argv) -> int {
+  Server server(parseConfig(argc, argv));
   server.run(PORT);
   return 0;
 }
\ No newline at end of file
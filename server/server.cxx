@@ -43,7 +43,35 @@ static void makeNonBlocking(std::int64_t fd) {
 }
 
 /**
- * @brief Runs the server event loop.
+ * @brief Disables Nagle's algorithm on a connection.
+ *
+ * Responses are already batched per read, so holding back the tail of a batch
+ * until the previous segment is acknowledged only adds a delayed ACK worth of
+ * latency to every pipeline.
+ *
+ * @param fd the connection file descriptor
+ */
+static void disableNagle(std::int64_t fd) {
+  constexpr std::int32_t val = 1;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val)) == -1)
+      [[unlikely]] {
+    std::cerr << "setsockopt() error" << '\n';
+  }
+}
+
+/**
+ * @struct Ready
+ * @brief A connection with replies held until the log is flushed.
+ *
+ */
+struct Ready {
+  std::int64_t fd;
+  bool hangup; // close it once the replies are out
+};
+
+/**
+ * @brief Runs one epoll event loop over the connections accepted by
+ * @p listener.
  *
  * This function first sets up the arguments for polling. The listening fd is
  * polled with the POLLIN flag. For the connection fd (connectionFd) the state
@@ -53,17 +81,21 @@ static void makeNonBlocking(std::int64_t fd) {
  * descriptors are ready for reading/writing and can process the connections in
  * the pollArgs vector.
  *
- * @param port The port to run the server on.
+ * Every reactor has its own epoll instance and connection table, the only
+ * state shared between reactors is the keyspace behind `Request`.
+ * When no event is ready, the loop gives the time to `Request::idle()` before
+ * it blocks, so a resize of the keyspace finishes while there is no traffic.
+ * It blocks until the nearest key deadline at most, so keys expire on time.
+ *
+ * Replies are held until every ready connection was read, then the
+ * append-only log is flushed once for all of them, and only then are the
+ * replies sent. A connection that stopped at OUTPUT_HIGH_WATER is read again
+ * in the next iteration, without waiting for an event. While the log fails to
+ * flush, the replies stay held and the flush is retried every AOF_RETRY_MS.
+ *
+ * @param listener The listening socket owned by this reactor.
  */
-void Server::run(std::int64_t port) {
-  socket.setOptions();
-  socket.configureConnection(port, SERVER_NETADDR, "server");
-  makeNonBlocking(socket.getFd());
-
-  if (listen(socket.getFd(), SERVER_BACKLOG)) {
-    throw std::runtime_error("Failed to listen");
-  }
-
+void Server::epollReactor(const Socket &listener) const {
   sockaddr_in clientAddress = {};
   socklen_t socketAddressLength = sizeof(clientAddress);
 
@@ -73,52 +105,435 @@ void Server::run(std::int64_t port) {
       MAX_EVENTS);
 
   std::int64_t epollFd = epoll_create(1);
-  registerEpollEvent(epollFd, socket.getFd(), EPOLLIN | EPOLLOUT | EPOLLET);
+  registerEpollEvent(epollFd, listener.getFd(), EPOLLIN | EPOLLOUT | EPOLLET);
 
-  // the event loop
+  // the event loop, it only blocks once the keyspace has no work left, and
+  // only until the next key expires
+  std::vector<Ready> ready;      // answered this iteration, replies held
+  std::vector<std::int64_t> again; // stalled, to answer without an event
+  bool idleWork = true;
   while (true) {
-    numFileDescriptors = epoll_wait(epollFd, events.data(), MAX_EVENTS, -1);
+    auto timeout = idleWork || !again.empty() ? 0 : Request::timeout();
+    if (!ready.empty()) {
+      timeout = AOF_RETRY_MS; // the replies wait for the log
+    }
+    numFileDescriptors =
+        epoll_wait(epollFd, events.data(), MAX_EVENTS, timeout);
+    if (numFileDescriptors == 0 && again.empty() && ready.empty()) {
+      idleWork = Request::idle();
+      continue;
+    }
+    idleWork = true; // the requests may have left some
+
+    for (auto fd : std::exchange(again, {})) {
+      if (auto &conn = connectionByFileDescriptor[fd]) {
+        conn->receive();
+        ready.push_back({fd, false});
+      }
+    }
+
     // connection fds
     for (auto i = 0; i < numFileDescriptors; ++i) {
-      if (events[i].data.fd == socket.getFd()) {
-        std::int64_t connectionFd =
-            accept(socket.getFd(), reinterpret_cast<sockaddr *>(&clientAddress),
-                   &socketAddressLength);
-        if (connectionFd < 0) {
-          std::cerr << "accept() error";
-          continue;
-        }
+      if (events[i].data.fd == listener.getFd()) {
+        // the listener is edge triggered, drain its whole accept queue
+        while (true) {
+          std::int64_t connectionFd = accept(
+              listener.getFd(), reinterpret_cast<sockaddr *>(&clientAddress),
+              &socketAddressLength);
+          if (connectionFd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+              std::cerr << "accept() error";
+            }
+            break;
+          }
 
-        makeNonBlocking(connectionFd);
-        registerEpollEvent(epollFd, connectionFd,
-                           EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP);
+          makeNonBlocking(connectionFd);
+          disableNagle(connectionFd);
+          registerEpollEvent(epollFd, connectionFd,
+                             EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP |
+                                 EPOLLHUP);
 
-        if (static_cast<std::size_t>(connectionFd) >=
-            connectionByFileDescriptor.size()) {
-          connectionByFileDescriptor.resize(connectionFd + 1);
+          if (static_cast<std::size_t>(connectionFd) >=
+              connectionByFileDescriptor.size()) {
+            connectionByFileDescriptor.resize(connectionFd + 1);
+          }
+          connectionByFileDescriptor[connectionFd] =
+              std::make_unique<Connection>(connectionFd, ConnectionState::REQ,
+                                           config.maxMessageSize);
         }
-        connectionByFileDescriptor[connectionFd] =
-            std::make_unique<Connection>(connectionFd, ConnectionState::REQ, 0);
 
       } else {
         auto &conn = connectionByFileDescriptor[events[i].data.fd];
         if (!conn) {
           std::cerr << "Connection not found for fd: " << events[i].data.fd
                     << '\n';
+          continue;
         }
         if (events[i].events & (EPOLLIN | EPOLLOUT)) {
-          conn->io();
-          if (conn->getState() == ConnectionState::END) {
-            epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->getFd(), nullptr);
-            connectionByFileDescriptor[conn->getFd()].reset();
+          conn->receive();
+        }
+        ready.push_back({events[i].data.fd,
+                         (events[i].events & (EPOLLRDHUP | EPOLLHUP)) != 0});
+      }
+    }
+
+    // the writes of every request answered above reach the log before any
+    // reply does, with one write (and sync) for all of them
+    if (!aof::flush()) {
+      continue; // no reply acknowledges a write that is not in the log
+    }
+    for (auto [fd, hangup] : std::exchange(ready, {})) {
+      auto &conn = connectionByFileDescriptor[fd];
+      if (!conn) {
+        continue; // listed twice, and closed the first time
+      }
+      bool stalled = conn->send();
+      // the requests that came with the hang up were answered above
+      if (hangup || conn->getState() == ConnectionState::END) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->getFd(), nullptr);
+        conn.reset();
+      } else if (stalled) {
+        again.push_back(fd);
+      }
+    }
+  }
+}
+
+/**
+ * @enum UringOp
+ * @brief The kind of operation a completion belongs to.
+ *
+ * Stored in the upper half of the completion user data, the lower half is the
+ * file descriptor the operation was issued on.
+ */
+enum class UringOp : std::uint8_t {
+  ACCEPT = 1,
+  RECV = 2,
+  SEND = 3,
+  TIMEOUT = 4,
+};
+
+/**
+ * @struct UringConnection
+ * @brief A connection driven by the io_uring reactor.
+ *
+ */
+struct UringConnection {
+  std::unique_ptr<Connection> conn;
+  std::array<iovec, MAX_OUTPUT_IOVECS> iov; // the output chunks being sent
+  msghdr message = {};                      // describes `iov` to the kernel
+  std::uint32_t inflight = 0; // operations still using the fd
+  bool sending = false;       // a send of the pending output is queued
+  bool held = false;          // a send waits for the log to be flushed
+  bool eof = false;           // the peer will not send anything else
+  bool closing = false;
+};
+
+static auto userData(UringOp op, std::int64_t fd) -> std::uint64_t {
+  return (static_cast<std::uint64_t>(op) << 32) |
+         static_cast<std::uint32_t>(fd);
+}
+
+static void armAccept(Ring &ring, std::int64_t fd) {
+  auto *sqe = ring.sqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = static_cast<std::int32_t>(fd);
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = userData(UringOp::ACCEPT, fd);
+}
+
+/**
+ * @struct Timer
+ * @brief The timeouts a uring reactor has in flight.
+ *
+ */
+struct Timer {
+  // the nearest timeout in flight, max once it fired
+  std::chrono::steady_clock::time_point until =
+      std::chrono::steady_clock::time_point::max();
+  __kernel_timespec spec = {}; // copied by the kernel on submission
+};
+
+// wakes the reactor in `ms` milliseconds, unless a timeout already does
+static void armTimeout(Ring &ring, Timer &timer, std::int32_t ms) {
+  if (ms < 0) {
+    return;
+  }
+  auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  if (timer.until <= until) {
+    return;
+  }
+
+  timer.spec.tv_sec = ms / 1000;
+  timer.spec.tv_nsec = static_cast<long long>(ms % 1000) * 1000000;
+  auto *sqe = ring.sqe();
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->fd = -1;
+  sqe->addr = reinterpret_cast<std::uint64_t>(&timer.spec);
+  sqe->len = 1;
+  sqe->user_data = userData(UringOp::TIMEOUT, 0);
+  timer.until = until;
+}
+
+static void armReceive(Ring &ring, UringConnection &uc) {
+  auto *sqe = ring.sqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = uc.conn->getFd();
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  sqe->user_data = userData(UringOp::RECV, uc.conn->getFd());
+  uc.inflight++;
+}
+
+static void submitSend(Ring &ring, UringConnection &uc) {
+  uc.message.msg_iov = uc.iov.data();
+  uc.message.msg_iovlen = uc.conn->pendingOutput(uc.iov);
+  auto *sqe = ring.sqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = uc.conn->getFd();
+  sqe->addr = reinterpret_cast<std::uint64_t>(&uc.message);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = userData(UringOp::SEND, uc.conn->getFd());
+  uc.inflight++;
+  uc.sending = true;
+}
+
+static void beginClose(UringConnection &uc) {
+  if (!uc.closing) {
+    uc.closing = true;
+    // completes the pending receive, the fd stays open until nothing uses it
+    shutdown(uc.conn->getFd(), SHUT_RDWR);
+  }
+}
+
+/**
+ * @brief Handles the buffered requests of a connection.
+ *
+ * Answers every complete request that was received so far. All of the queued
+ * responses go out with a single IORING_OP_SENDMSG over the output chunks,
+ * once the append-only log is flushed at the end of the batch. Only one send
+ * is in flight at a time, responses queued meanwhile go out with the next one.
+ *
+ * @param held The connections with a send waiting for the log.
+ * @param uc The connection to drive.
+ */
+static void drive(std::vector<std::int32_t> &held, UringConnection &uc) {
+  if (uc.closing) {
+    return;
+  }
+
+  auto &conn = *uc.conn;
+  conn.processRequests();
+
+  if (conn.getState() == ConnectionState::END) {
+    beginClose(uc);
+  } else if (uc.sending || uc.held) {
+    return; // picked up again once the send completes
+  } else if (conn.pendingOutputSize()) {
+    uc.held = true;
+    held.push_back(conn.getFd());
+  } else if (uc.eof) {
+    beginClose(uc); // everything received before the EOF was answered
+  }
+}
+
+/**
+ * @brief Runs one io_uring event loop over the connections accepted by
+ * @p listener.
+ *
+ * Connections are accepted with a multishot accept and read with a multishot
+ * receive that picks its buffers from the ring of provided buffers, so no
+ * readiness notification or read() is needed per request. All responses to
+ * the requests received so far go out in one IORING_OP_SENDMSG. Every
+ * operation queued while handling a batch of completions goes to the kernel in
+ * a single io_uring_enter().
+ *
+ * A connection is only destroyed (and its fd closed) once none of its
+ * operations are in flight anymore, so the fd can not be reused under a
+ * pending completion.
+ *
+ * Like the epoll loop, it flushes the append-only log before any reply of a
+ * batch goes out, runs `Request::idle()` before it blocks, and arms a timeout
+ * for the nearest key deadline. Sends held for a failing log wait for the
+ * next flush, at most AOF_RETRY_MS away.
+ *
+ * @param listener The listening socket owned by this reactor.
+ */
+void Server::uringReactor(const Socket &listener) const {
+  Ring ring(URING_ENTRIES);
+  std::vector<std::unique_ptr<UringConnection>> connectionByFileDescriptor(
+      MAX_EVENTS);
+
+  armAccept(ring, listener.getFd());
+
+  // the event loop, it only blocks once the keyspace has no work left
+  bool idleWork = true;
+  Timer timer;
+  std::vector<std::int32_t> held; // answered this batch, sends held
+  while (true) {
+    bool waiting = !held.empty(); // for the log
+    if (waiting) {
+      armTimeout(ring, timer, AOF_RETRY_MS);
+    } else if (!idleWork) {
+      armTimeout(ring, timer, Request::timeout());
+    }
+    ring.submitAndWait(idleWork && !waiting ? 0 : 1);
+    if (!ring.peek() && !waiting) {
+      idleWork = Request::idle();
+      continue;
+    }
+    idleWork = true; // the requests may have left some
+
+    while (auto *cqe = ring.peek()) {
+      auto op = static_cast<UringOp>(cqe->user_data >> 32);
+      auto fd = static_cast<std::int32_t>(cqe->user_data & 0xFFFFFFFF);
+      std::int32_t res = cqe->res;
+      std::uint32_t flags = cqe->flags;
+      ring.advance();
+
+      if (op == UringOp::TIMEOUT) {
+        // only wakes the loop, idle() does the expiring. A later timeout may
+        // still be in flight, that is a spurious wake up at worst
+        timer.until = std::chrono::steady_clock::time_point::max();
+        continue;
+      }
+
+      if (op == UringOp::ACCEPT) {
+        if (res < 0) {
+          std::cerr << "accept() error" << '\n';
+        } else {
+          if (static_cast<std::size_t>(res) >=
+              connectionByFileDescriptor.size()) {
+            connectionByFileDescriptor.resize(res + 1);
           }
+          disableNagle(res);
+          auto &uc = connectionByFileDescriptor[res];
+          uc = std::make_unique<UringConnection>();
+          uc->conn = std::make_unique<Connection>(res, ConnectionState::REQ,
+                                                  config.maxMessageSize);
+          armReceive(ring, *uc);
         }
+        if (!(flags & IORING_CQE_F_MORE)) {
+          armAccept(ring, listener.getFd());
+        }
+        continue;
       }
-      if (events[i].events & (EPOLLRDHUP | EPOLLHUP)) {
-        epoll_ctl(epollFd, EPOLL_CTL_DEL, events[i].data.fd, nullptr);
-        close(events[i].data.fd);
-        connectionByFileDescriptor[events[i].data.fd].reset();
+
+      auto &uc = connectionByFileDescriptor[fd];
+      if (!uc) {
+        std::cerr << "Connection not found for fd: " << fd << '\n';
+        continue;
       }
+
+      if (op == UringOp::RECV) {
+        bool overflow = false;
+        if (flags & IORING_CQE_F_BUFFER) {
+          auto id = static_cast<std::uint16_t>(flags >>
+                                               IORING_CQE_BUFFER_SHIFT);
+          if (res > 0 && !uc->closing) {
+            auto size = static_cast<std::size_t>(res);
+            overflow = uc->conn->feed(ring.buffer(id), size) < size;
+          }
+          ring.recycle(id);
+        }
+
+        if (res == 0) {
+          uc->eof = true;
+          drive(held, *uc);
+        } else if (res < 0 && res != -ENOBUFS) {
+          beginClose(*uc);
+        } else if (overflow) {
+          std::println("too long");
+          beginClose(*uc);
+        } else if (res > 0) {
+          drive(held, *uc);
+        }
+
+        if (!(flags & IORING_CQE_F_MORE)) {
+          uc->inflight--;
+          if (!uc->closing && !uc->eof) {
+            armReceive(ring, *uc); // out of buffers, or the kernel stopped it
+          }
+        }
+      } else if (op == UringOp::SEND) {
+        uc->inflight--;
+        uc->sending = false;
+        if (res < 0) {
+          if (!uc->closing) {
+            std::cerr << "send() error" << '\n';
+          }
+          beginClose(*uc);
+        } else if (!uc->closing) {
+          uc->conn->consumeOutput(static_cast<std::size_t>(res));
+          drive(held, *uc); // sends what is left, including a short send
+        }
+      }
+
+      if (uc->closing && uc->inflight == 0) {
+        uc.reset();
+      }
+    }
+
+    // the writes of every request answered above reach the log before any
+    // reply does, the sends are submitted with the next io_uring_enter()
+    if (!aof::flush()) {
+      continue; // no reply acknowledges a write that is not in the log
+    }
+    for (auto fd : std::exchange(held, {})) {
+      auto &uc = connectionByFileDescriptor[fd];
+      if (uc && std::exchange(uc->held, false) && !uc->closing) {
+        submitSend(ring, *uc);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Runs the server event loops.
+ *
+ * Starts `config.reactors` reactors. Each reactor owns a listening socket
+ * bound to @p port with SO_REUSEPORT, an epoll instance or io_uring ring
+ * (depending on `config.backend`) and the connections it accepted, so the
+ * reactors never share any connection state. The first reactor runs on the
+ * calling thread, the rest get a thread each.
+ *
+ * @param port The port to run the server on.
+ */
+void Server::run(std::int64_t port) {
+  // a peer that goes away with responses still queued must not kill us
+  std::signal(SIGPIPE, SIG_IGN);
+  Request::limitMemory(config.maxMemory, config.eviction);
+  zset::limitPack(config.zsetPackMembers, config.zsetPackName);
+  // with a log, the log alone has every key
+  Request::loadSnapshot(config.snapshot, config.appendOnly.empty());
+  Request::openLog(config.appendOnly, config.appendFsync);
+
+  std::vector<std::unique_ptr<Socket>> listeners;
+  listeners.reserve(config.reactors);
+
+  for (std::size_t i = 0; i < config.reactors; ++i) {
+    auto &listener = listeners.emplace_back(std::make_unique<Socket>());
+    listener->setOptions();
+    if (config.reactors > 1) {
+      listener->setReusePort();
+    }
+    listener->configureConnection(port, SERVER_NETADDR, "server");
+    makeNonBlocking(listener->getFd());
+
+    if (listen(listener->getFd(), SERVER_BACKLOG)) {
+      throw std::runtime_error("Failed to listen");
     }
   }
+
+  auto reactor = config.backend == Backend::URING ? &Server::uringReactor
+                                                  : &Server::epollReactor;
+
+  std::vector<std::jthread> threads;
+  threads.reserve(config.reactors - 1);
+  for (std::size_t i = 1; i < config.reactors; ++i) {
+    threads.emplace_back(reactor, this, std::cref(*listeners[i]));
+  }
+  (this->*reactor)(*listeners[0]);
 }
\ No newline at end of file
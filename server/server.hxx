@@ -1,15 +1,22 @@
+#include <netinet/tcp.h>
 #include <sys/epoll.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <array>
+#include <csignal>
 #include <cstring>
 #include <iostream>
 #include <memory>
 #include <print>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "common/conn.hxx"
 #include "common/socket.hxx"
+#include "config.hxx"
+#include "uring.hxx"
 
 constexpr std::int64_t SERVER_PORT = 1234;
 constexpr std::int64_t SERVER_NETADDR = 0;
@@ -25,20 +32,41 @@ public:
   Server() = default;
 
   /**
-   * @brief Runs the server event loop.
+   * @brief Construct a new Server object with the given settings.
    *
-   * This function first sets up the arguments for polling. The listening fd is
-   * polled with the POLLIN flag. For the connection fd (connFd) the state of
-   * the connection object (Connection) determines the poll flag. In this
-   * scenario, the poll flag is either reading (POLLIN) or writing (POLLOUT),
-   * never both. After `poll` returns, the server gets notified by which file
-   * descriptors are ready for reading/writing and can process the connections
-   * in the pollArgs vector.
+   * @param config The runtime settings of the server.
+   */
+  explicit Server(const Config &config) : config(config) {}
+
+  /**
+   * @brief Runs the server event loops.
+   *
+   * Starts `config.reactors` reactors. Each reactor owns a listening socket
+   * bound to @p port with SO_REUSEPORT, an epoll instance or io_uring ring
+   * (depending on `config.backend`) and the connections it accepted, so the
+   * reactors never share any connection state. The first reactor runs on the
+   * calling thread, the rest get a thread each.
    *
    * @param port The port to run the server on.
    */
   void run(std::int64_t port);
 
 private:
-  Socket socket;
+  Config config;
+
+  /**
+   * @brief Runs one epoll event loop over the connections accepted by
+   * @p listener.
+   *
+   * @param listener The listening socket owned by this reactor.
+   */
+  void epollReactor(const Socket &listener) const;
+
+  /**
+   * @brief Runs one io_uring event loop over the connections accepted by
+   * @p listener.
+   *
+   * @param listener The listening socket owned by this reactor.
+   */
+  void uringReactor(const Socket &listener) const;
 };
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "uring.hxx"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+static auto setup(std::uint32_t entries, io_uring_params &params)
+    -> std::int32_t {
+  return static_cast<std::int32_t>(
+      syscall(__NR_io_uring_setup, entries, &params));
+}
+
+static auto enter(std::int32_t fd, std::uint32_t toSubmit,
+                  std::uint32_t minComplete, std::uint32_t flags)
+    -> std::int32_t {
+  return static_cast<std::int32_t>(syscall(__NR_io_uring_enter, fd, toSubmit,
+                                           minComplete, flags, nullptr, 0));
+}
+
+static auto registerRing(std::int32_t fd, std::uint32_t opcode, void *arg,
+                         std::uint32_t nrArgs) -> std::int32_t {
+  return static_cast<std::int32_t>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+static auto at(void *base, std::uint32_t offset) -> std::uint32_t * {
+  return reinterpret_cast<std::uint32_t *>(static_cast<char *>(base) + offset);
+}
+
+/**
+ * @brief Construct a new Ring object
+ *
+ * Sets up the ring and maps its submission queue, completion queue and
+ * submission entries into memory. Then registers a ring of
+ * URING_BUFFER_COUNT buffers of URING_BUFFER_SIZE bytes in group
+ * URING_BUFFER_GROUP, so the kernel can pick a buffer for a receive only when
+ * data actually arrives instead of every connection pinning its own.
+ *
+ * @param entries The number of submission queue entries.
+ * @throws std::runtime_error If io_uring is not available.
+ */
+Ring::Ring(std::uint32_t entries) {
+  io_uring_params params = {};
+  params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+  fd = setup(entries, params);
+  if (fd < 0) [[unlikely]] {
+    throw std::runtime_error("Failed to set up io_uring");
+  }
+
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+  }
+
+  sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sqRing == MAP_FAILED) [[unlikely]] {
+    sqRing = nullptr;
+    release();
+    throw std::runtime_error("Failed to map io_uring submission queue");
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cqRing = sqRing;
+  } else {
+    cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED) [[unlikely]] {
+      cqRing = nullptr;
+      release();
+      throw std::runtime_error("Failed to map io_uring completion queue");
+    }
+  }
+
+  sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqesSize,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, fd,
+                                          IORING_OFF_SQES));
+  if (sqes == MAP_FAILED) [[unlikely]] {
+    sqes = nullptr;
+    release();
+    throw std::runtime_error("Failed to map io_uring submission entries");
+  }
+
+  sqHead = at(sqRing, params.sq_off.head);
+  sqTail = at(sqRing, params.sq_off.tail);
+  sqMask = *at(sqRing, params.sq_off.ring_mask);
+  sqEntries = *at(sqRing, params.sq_off.ring_entries);
+  sqArray = at(sqRing, params.sq_off.array);
+  sqLocalTail = *sqTail;
+  sqSubmitted = sqLocalTail;
+
+  cqHead = at(cqRing, params.cq_off.head);
+  cqTail = at(cqRing, params.cq_off.tail);
+  cqMask = *at(cqRing, params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe *>(static_cast<char *>(cqRing) +
+                                          params.cq_off.cqes);
+
+  // provided buffers for multishot receives
+  bufferRingSize = URING_BUFFER_COUNT * sizeof(io_uring_buf);
+  void *ring = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) [[unlikely]] {
+    release();
+    throw std::runtime_error("Failed to allocate io_uring buffer ring");
+  }
+  bufferRing = static_cast<io_uring_buf_ring *>(ring);
+
+  io_uring_buf_reg reg = {};
+  reg.ring_addr = reinterpret_cast<std::uint64_t>(bufferRing);
+  reg.ring_entries = URING_BUFFER_COUNT;
+  reg.bgid = URING_BUFFER_GROUP;
+  if (registerRing(fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) [[unlikely]] {
+    release();
+    throw std::runtime_error("Failed to register io_uring buffer ring");
+  }
+
+  buffers.resize(static_cast<std::size_t>(URING_BUFFER_COUNT) *
+                 URING_BUFFER_SIZE);
+  for (std::uint16_t id = 0; id < URING_BUFFER_COUNT; ++id) {
+    recycle(id);
+  }
+}
+
+/**
+ * @brief Destroy the Ring object
+ *
+ * Unmaps the queues and closes the ring file descriptor, which also cancels
+ * whatever is still in flight.
+ */
+Ring::~Ring() { release(); }
+
+void Ring::release() {
+  if (bufferRing) {
+    munmap(bufferRing, bufferRingSize);
+    bufferRing = nullptr;
+  }
+  if (sqes) {
+    munmap(sqes, sqesSize);
+    sqes = nullptr;
+  }
+  if (cqRing && cqRing != sqRing) {
+    munmap(cqRing, cqRingSize);
+  }
+  cqRing = nullptr;
+  if (sqRing) {
+    munmap(sqRing, sqRingSize);
+    sqRing = nullptr;
+  }
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+auto Ring::sqe() -> io_uring_sqe * {
+  if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+    submitAndWait(0); // the queue is full, make room
+  }
+
+  std::uint32_t index = sqLocalTail & sqMask;
+  sqArray[index] = index;
+  sqLocalTail++;
+
+  auto *entry = &sqes[index];
+  std::memset(entry, 0, sizeof(*entry));
+  return entry;
+}
+
+auto Ring::submitAndWait(std::uint32_t waitFor) -> std::int32_t {
+  std::uint32_t toSubmit = sqLocalTail - sqSubmitted;
+  __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+  std::int32_t submitted = 0;
+  do {
+    submitted = enter(fd, toSubmit, waitFor,
+                      waitFor ? IORING_ENTER_GETEVENTS : 0);
+  } while (submitted < 0 && errno == EINTR);
+
+  if (submitted < 0) {
+    return -errno;
+  }
+  sqSubmitted += static_cast<std::uint32_t>(submitted);
+  return submitted;
+}
+
+auto Ring::peek() -> io_uring_cqe * {
+  std::uint32_t head = *cqHead;
+  if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+    return nullptr;
+  }
+  return &cqes[head & cqMask];
+}
+
+void Ring::advance() {
+  __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+auto Ring::buffer(std::uint16_t id) -> std::uint8_t * {
+  return buffers.data() + static_cast<std::size_t>(id) * URING_BUFFER_SIZE;
+}
+
+void Ring::recycle(std::uint16_t id) {
+  std::uint16_t tail = bufferRing->tail;
+  // index by hand, `bufs` is misplaced when the uapi header is built as C++
+  auto &slot = reinterpret_cast<io_uring_buf *>(
+      bufferRing)[tail & (URING_BUFFER_COUNT - 1)];
+  slot.addr = reinterpret_cast<std::uint64_t>(buffer(id));
+  slot.len = URING_BUFFER_SIZE;
+  slot.bid = id;
+  __atomic_store_n(&bufferRing->tail, static_cast<std::uint16_t>(tail + 1),
+                   __ATOMIC_RELEASE);
+}
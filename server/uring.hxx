@@ -0,0 +1,113 @@
+#pragma once
+#include <linux/io_uring.h>
+
+#include <cstdint>
+#include <vector>
+
+constexpr std::uint32_t URING_ENTRIES = 256;
+constexpr std::uint16_t URING_BUFFER_COUNT = 256; // must be a power of 2
+constexpr std::uint32_t URING_BUFFER_SIZE = 4096;
+constexpr std::uint16_t URING_BUFFER_GROUP = 0;
+
+/**
+ * @class Ring
+ * @brief A minimal io_uring instance driven through the raw syscalls.
+ *
+ * Owns the submission and completion queues of one ring plus a ring of
+ * provided buffers that multishot receives pick their buffers from. A ring is
+ * meant to be used by a single thread.
+ */
+class Ring {
+public:
+  /**
+   * @brief Construct a new Ring object
+   *
+   * Sets up the ring, maps its queues and registers the provided buffers.
+   *
+   * @param entries The number of submission queue entries.
+   * @throws std::runtime_error If io_uring is not available.
+   */
+  explicit Ring(std::uint32_t entries);
+
+  /**
+   * @brief Destroy the Ring object
+   *
+   * Unmaps the queues and closes the ring file descriptor.
+   */
+  ~Ring();
+
+  Ring(const Ring &) = delete;
+  auto operator=(const Ring &) -> Ring & = delete;
+
+  /**
+   * @brief Get a zeroed submission queue entry.
+   *
+   * Submits the queued entries first if the submission queue is full.
+   *
+   * @return the entry to fill in.
+   */
+  auto sqe() -> io_uring_sqe *;
+
+  /**
+   * @brief Submits every queued entry and waits for @p waitFor completions.
+   *
+   * @param waitFor The number of completions to wait for.
+   * @return the number of submitted entries, or -errno on failure.
+   */
+  auto submitAndWait(std::uint32_t waitFor) -> std::int32_t;
+
+  /**
+   * @brief Get the next completion queue entry without consuming it.
+   *
+   * @return the completion, or nullptr if the completion queue is empty.
+   */
+  auto peek() -> io_uring_cqe *;
+
+  /**
+   * @brief Marks the completion returned by `peek()` as consumed.
+   */
+  void advance();
+
+  /**
+   * @brief Get the address of a provided buffer.
+   *
+   * @param id The buffer id reported by the completion.
+   * @return the start of the buffer.
+   */
+  auto buffer(std::uint16_t id) -> std::uint8_t *;
+
+  /**
+   * @brief Hands a provided buffer back to the kernel.
+   *
+   * @param id The buffer id to recycle.
+   */
+  void recycle(std::uint16_t id);
+
+private:
+  void release();
+
+  std::int32_t fd = -1;
+  void *sqRing = nullptr;
+  void *cqRing = nullptr;
+  std::size_t sqRingSize = 0;
+  std::size_t cqRingSize = 0;
+  io_uring_sqe *sqes = nullptr;
+  std::size_t sqesSize = 0;
+
+  std::uint32_t *sqHead = nullptr;
+  std::uint32_t *sqTail = nullptr;
+  std::uint32_t sqMask = 0;
+  std::uint32_t sqEntries = 0;
+  std::uint32_t *sqArray = nullptr;
+  std::uint32_t sqLocalTail = 0;
+  std::uint32_t sqSubmitted = 0;
+
+  std::uint32_t *cqHead = nullptr;
+  std::uint32_t *cqTail = nullptr;
+  std::uint32_t cqMask = 0;
+  io_uring_cqe *cqes = nullptr;
+
+  io_uring_buf_ring *bufferRing = nullptr;
+  std::size_t bufferRingSize = 0;
+  std::vector<std::uint8_t> buffers;
+};
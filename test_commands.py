@@ -29,6 +29,8 @@ def start_server():
 CASES = r"""
 $ bazel run //client:client -- zscore asdf n1
 (nil)
+$ bazel run //client:client -- zscore asdf
+(err) 5 wrong number of arguments
 $ bazel run //client:client -- zquery xxx 1 asdf 1 10
 (arr) len=0
 (arr) end
@@ -64,6 +66,138 @@ $ bazel run //client:client -- zquery zset 1 "" 0 10
 (str) n2
 (double) 2
 (arr) end
+$ bazel run //client:client -- get zset
+(err) 3 expect string
+$ bazel run //client:client -- set k 42
+(nil)
+$ bazel run //client:client -- get k
+(str) 42
+$ bazel run //client:client -- set k 007
+(nil)
+$ bazel run //client:client -- get k
+(str) 007
+$ bazel run //client:client -- set k a_value_too_long_to_be_stored_inline
+(nil)
+$ bazel run //client:client -- get k
+(str) a_value_too_long_to_be_stored_inline
+$ bazel run //client:client -- scan 0 match z?[a-s]t count 1000
+(arr) len=2
+(int) 0
+(arr) len=1
+(str) zset
+(arr) end
+(arr) end
+$ bazel run //client:client -- scan 0 match nothing*
+(arr) len=2
+(int) 0
+(arr) len=0
+(arr) end
+(arr) end
+$ bazel run //client:client -- scan -1
+(err) 4 invalid cursor
+$ bazel run //client:client -- scan 0 count 0
+(err) 4 expect positive int
+$ bazel run //client:client -- set t v
+(nil)
+$ bazel run //client:client -- ttl t
+(int) -1
+$ bazel run //client:client -- expire t 100
+(int) 1
+$ bazel run //client:client -- ttl t
+(int) 100
+$ bazel run //client:client -- pexpire t 200000
+(int) 1
+$ bazel run //client:client -- ttl t
+(int) 200
+$ bazel run //client:client -- persist t
+(int) 1
+$ bazel run //client:client -- ttl t
+(int) -1
+$ bazel run //client:client -- pexpire t 1
+(int) 1
+$ bazel run //client:client -- get t
+(nil)
+$ bazel run //client:client -- ttl t
+(int) -2
+$ bazel run //client:client -- expire t 10
+(int) 0
+$ bazel run //client:client -- expire zset x
+(err) 4 invalid expire time
+$ bazel run //client:client -- set t v
+(nil)
+$ bazel run //client:client -- pexpireat t 1
+(int) 1
+$ bazel run //client:client -- get t
+(nil)
+$ bazel run //client:client -- pexpireat t 1
+(int) 0
+$ bazel run //client:client -- mset k1 v1 k2 2 k3
+(err) 5 wrong number of arguments
+$ bazel run //client:client -- mset k1 v1 k2 2
+(nil)
+$ bazel run //client:client -- mget k1 zset k2 k3
+(arr) len=4
+(str) v1
+(nil)
+(str) 2
+(nil)
+(arr) end
+$ bazel run //client:client -- mdel k1 k2 k3
+(int) 2
+$ bazel run //client:client -- del k
+(int) 1
+$ bazel run //client:client -- get k
+(nil)
+$ bazel run //client:client -- zadd lazy 1 n1
+(int) 1
+$ bazel run //client:client -- set lazy v
+(nil)
+$ bazel run //client:client -- get lazy
+(str) v
+$ bazel run //client:client -- unlink lazy k1
+(int) 1
+$ bazel run //client:client -- get lazy
+(nil)
+$ bazel run //client:client -- incr counter
+(int) 1
+$ bazel run //client:client -- incrby counter 41
+(int) 42
+$ bazel run //client:client -- decrby counter 50
+(int) -8
+$ bazel run //client:client -- decr counter
+(int) -9
+$ bazel run //client:client -- get counter
+(str) -9
+$ bazel run //client:client -- incrby counter 9223372036854775807
+(int) 9223372036854775798
+$ bazel run //client:client -- incr counter
+(int) 9223372036854775799
+$ bazel run //client:client -- incrby counter 9
+(err) 4 overflow
+$ bazel run //client:client -- incrby counter x
+(err) 4 expect int
+$ bazel run //client:client -- set long aaaaaaaaaaaaaaaaaaaa
+(nil)
+$ bazel run //client:client -- set long 12345678901234567
+(nil)
+$ bazel run //client:client -- incr long
+(int) 12345678901234568
+$ bazel run //client:client -- set counter 007
+(nil)
+$ bazel run //client:client -- incr counter
+(err) 4 expect int value
+$ bazel run //client:client -- incrbyfloat counter 0.5
+(double) 7.5
+$ bazel run //client:client -- incrbyfloat counter 2.5
+(double) 10
+$ bazel run //client:client -- incr counter
+(int) 11
+$ bazel run //client:client -- incr zset
+(err) 3 expect string
+$ bazel run //client:client -- save
+(err) 1 no snapshot file
+$ bazel run //client:client -- bgsave
+(err) 1 no snapshot file
 """
 
 
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <csignal>
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/aof.hxx"
+
+static auto logPath() -> std::string {
+  return (std::filesystem::temp_directory_path() /
+          ("test_aof." + std::to_string(getpid())))
+      .string();
+}
+
+// the arguments of a frame payload: u32 count, then u32 length and bytes each
+static auto decode(std::span<std::uint8_t> payload)
+    -> std::vector<std::string> {
+  std::vector<std::string> args;
+  std::uint32_t count = 0;
+  std::memcpy(&count, payload.data(), 4);
+  std::size_t at = 4;
+  for (; count > 0; --count) {
+    std::uint32_t len = 0;
+    std::memcpy(&len, payload.data() + at, 4);
+    args.emplace_back(reinterpret_cast<const char *>(payload.data() + at + 4),
+                      len);
+    at += 4 + len;
+  }
+  return args;
+}
+
+static auto replayAll(const std::string &path)
+    -> std::vector<std::vector<std::string>> {
+  std::vector<std::vector<std::string>> commands;
+  aof::replay(path, [&](std::span<std::uint8_t> payload) {
+    commands.push_back(decode(payload));
+  });
+  return commands;
+}
+
+TEST(AofTest, MissingLogReplaysNothing) {
+  EXPECT_EQ(aof::replay(logPath() + ".none", [](auto) { FAIL(); }), 0);
+}
+
+TEST(AofTest, ReplaysFlushedCommandsAndCutsATornTail) {
+  auto path = logPath();
+  std::filesystem::remove(path);
+  aof::open(path, Fsync::ALWAYS);
+  ASSERT_TRUE(aof::enabled());
+
+  std::array<std::string_view, 3> set = {"set", "key", "value"};
+  std::array<std::string_view, 2> del = {"del", "key"};
+  aof::append(set);
+  aof::append(del);
+  EXPECT_EQ(aof::stats().writes, 0); // buffered until the flush
+  aof::flush();
+  aof::flush(); // nothing new, no write
+
+  auto stats = aof::stats();
+  EXPECT_EQ(stats.writes, 1);
+  EXPECT_EQ(stats.fsyncs, 1);
+  EXPECT_EQ(stats.errors, 0);
+  auto whole = std::filesystem::file_size(path);
+  EXPECT_EQ(stats.writtenBytes, whole);
+
+  // a crash in the middle of the next write
+  int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+  ASSERT_GE(fd, 0);
+  std::array<char, 6> torn = {0x20, 0, 0, 0, 2, 0};
+  ASSERT_EQ(::write(fd, torn.data(), torn.size()), torn.size());
+  ::close(fd);
+
+  auto commands = replayAll(path);
+  ASSERT_EQ(commands.size(), 2);
+  EXPECT_EQ(commands[0], (std::vector<std::string>{"set", "key", "value"}));
+  EXPECT_EQ(commands[1], (std::vector<std::string>{"del", "key"}));
+  EXPECT_EQ(std::filesystem::file_size(path), whole);
+  std::filesystem::remove(path);
+}
+
+TEST(AofTest, FailedFlushCutsTheFileAndKeepsTheCommands) {
+  auto path = logPath();
+  std::filesystem::remove(path);
+  aof::open(path, Fsync::NO);
+
+  std::array<std::string_view, 3> set = {"set", "key", "value"};
+  aof::append(set);
+  ASSERT_TRUE(aof::flush());
+  auto whole = std::filesystem::file_size(path);
+
+  // the file may only grow by a few bytes, the next write stops half way
+  rlimit limit = {};
+  ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &limit), 0);
+  auto saved = limit;
+  limit.rlim_cur = whole + 10;
+  auto handler = std::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+  std::array<std::string_view, 3> big = {"set", "big", std::string(100, 'v')};
+  aof::append(big);
+  EXPECT_FALSE(aof::flush());
+  EXPECT_TRUE(aof::failing());
+  EXPECT_EQ(aof::stats().errors, 1);
+  EXPECT_EQ(std::filesystem::file_size(path), whole); // no half frame
+
+  ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &saved), 0);
+  std::signal(SIGXFSZ, handler);
+
+  // the retry writes what the failed flush had
+  aof::append(set);
+  EXPECT_TRUE(aof::flush());
+  EXPECT_FALSE(aof::failing());
+  auto commands = replayAll(path);
+  ASSERT_EQ(commands.size(), 3);
+  EXPECT_EQ(commands[1][1], "big");
+  EXPECT_EQ(commands[2][1], "key");
+  EXPECT_EQ(aof::stats().writtenBytes, std::filesystem::file_size(path));
+  std::filesystem::remove(path);
+}
+
+TEST(AofTest, CutsOnlyATornLastCommand) {
+  auto path = logPath();
+  std::filesystem::remove(path);
+  aof::open(path, Fsync::NO);
+  std::array<std::string_view, 3> set = {"set", "key", "value"};
+  aof::append(set);
+  aof::append(set);
+  ASSERT_TRUE(aof::flush());
+  auto whole = std::filesystem::file_size(path);
+
+  // the last frame lost its final bytes
+  std::filesystem::resize_file(path, whole - 3);
+  ASSERT_EQ(replayAll(path).size(), 1);
+  EXPECT_EQ(std::filesystem::file_size(path), whole / 2);
+  std::filesystem::remove(path);
+}
+
+TEST(AofTest, RejectsACorruptMiddleCommand) {
+  auto path = logPath();
+  std::filesystem::remove(path);
+  aof::open(path, Fsync::NO);
+  std::array<std::string_view, 3> set = {"set", "key", "value"};
+  for (int i = 0; i < 3; ++i) {
+    aof::append(set);
+  }
+  ASSERT_TRUE(aof::flush());
+  auto whole = std::filesystem::file_size(path);
+
+  // the length of the second frame runs past the end of the file
+  int fd = ::open(path.c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  std::uint32_t length = 1 << 20;
+  ASSERT_EQ(::pwrite(fd, &length, 4, static_cast<off_t>(whole / 3)), 4);
+  ::close(fd);
+
+  EXPECT_THROW(replayAll(path), std::runtime_error);
+  EXPECT_EQ(std::filesystem::file_size(path), whole); // nothing cut
+
+  // and an argument longer than its frame
+  fd = ::open(path.c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  length = static_cast<std::uint32_t>(whole / 3 - 4);
+  ASSERT_EQ(::pwrite(fd, &length, 4, static_cast<off_t>(whole / 3)), 4);
+  std::uint32_t len = 1000;
+  ASSERT_EQ(::pwrite(fd, &len, 4, static_cast<off_t>(whole / 3 + 8)), 4);
+  ::close(fd);
+  EXPECT_THROW(replayAll(path), std::runtime_error);
+  EXPECT_EQ(std::filesystem::file_size(path), whole);
+  std::filesystem::remove(path);
+}
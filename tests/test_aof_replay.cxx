@@ -0,0 +1,187 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <set>
+
+#include "common.hxx"
+
+constexpr std::int64_t TEST_PORT = 24456;
+constexpr std::size_t TEST_KEYS = 2000;
+constexpr std::size_t TEST_VALUE_SIZE = 1000;
+constexpr std::size_t TEST_HOT_KEYS = 10;
+constexpr std::size_t TEST_MAX_MEMORY = 256 << 10; // a fraction of the keys
+
+static void appendFrame(std::string &buffer, const CommandList &commands) {
+  std::uint32_t messageLength = 4;
+  for (const auto &s : commands) {
+    messageLength += 4 + s.size();
+  }
+  auto n = static_cast<std::uint32_t>(commands.size());
+  buffer.append(reinterpret_cast<char *>(&messageLength), 4);
+  buffer.append(reinterpret_cast<char *>(&n), 4);
+  for (const auto &s : commands) {
+    auto len = static_cast<std::uint32_t>(s.size());
+    buffer.append(reinterpret_cast<char *>(&len), 4);
+    buffer.append(s);
+  }
+}
+
+static auto readFrame(const Socket &socket, std::int64_t fd) -> std::string {
+  std::string header(4, '\0');
+  if (socket.readFull(fd, header, 4)) {
+    return "";
+  }
+  std::uint32_t len = 0;
+  std::memcpy(&len, header.data(), 4);
+
+  std::string body(len, '\0');
+  if (socket.readFull(fd, body, len)) {
+    return "";
+  }
+  return body;
+}
+
+/**
+ * @class AofReplayTest
+ * @brief Test fixture for servers that log to, and start from, one log file.
+ *
+ * Every server runs in a separate process on its own port, under a memory
+ * limit that keeps it evicting.
+ */
+class AofReplayTest : public ::testing::Test {
+protected:
+  std::string path = (std::filesystem::temp_directory_path() /
+                      ("test_aof_replay." + std::to_string(getpid())))
+                         .string();
+  pid_t serverPid = 0;
+  std::int64_t port = TEST_PORT;
+
+  void SetUp() override { std::filesystem::remove(path); }
+
+  void TearDown() override {
+    stopServer();
+    std::filesystem::remove(path);
+  }
+
+  void startServer() {
+    port++;
+    serverPid = fork();
+    if (serverPid == 0) {
+      try {
+        Config config;
+        config.maxMemory = TEST_MAX_MEMORY;
+        config.eviction = Eviction::LFU;
+        config.appendOnly = path;
+        config.appendFsync = Fsync::ALWAYS;
+        Server server(config);
+        server.run(port);
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        exit(1);
+      }
+      exit(0);
+    }
+    ASSERT_GT(serverPid, 0);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+
+  void stopServer() {
+    if (serverPid > 0) {
+      kill(serverPid, SIGTERM);
+      waitpid(serverPid, nullptr, 0);
+      serverPid = 0;
+    }
+  }
+
+  // the names in the KEYS reply of the running server
+  auto keys() -> std::set<std::string> {
+    Socket socket;
+    socket.setOptions();
+    socket.configureConnection(port, TEST_CLIENT_NETADDR, "client");
+    std::string request;
+    appendFrame(request, {"keys"});
+    EXPECT_EQ(socket.writeAll(socket.getFd(), request, request.size()), 0);
+
+    auto reply = readFrame(socket, socket.getFd());
+    std::set<std::string> names;
+    std::uint32_t n = 0;
+    std::memcpy(&n, reply.data() + 1, 4);
+    std::size_t at = 1 + 4;
+    for (; n > 0; --n) {
+      std::uint32_t len = 0;
+      std::memcpy(&len, reply.data() + at + 1, 4);
+      names.emplace(reply.substr(at + 1 + 4, len));
+      at += 1 + 4 + len;
+    }
+    return names;
+  }
+};
+
+/**
+ * @test Fills a server far past its memory limit, then starts a second one
+ * from the log and checks that the same keys survived the replay.
+ */
+TEST_F(AofReplayTest, ReplayKeepsTheKeysThatSurvivedEviction) {
+  startServer();
+  Socket socket;
+  socket.setOptions();
+  socket.configureConnection(port, TEST_CLIENT_NETADDR, "client");
+  auto fd = socket.getFd();
+
+  // the reads keep a few keys hot, and they are not in the log
+  std::string batch;
+  for (std::size_t i = 0; i < TEST_KEYS; ++i) {
+    appendFrame(batch, {"set", "k" + std::to_string(i),
+                        std::string(TEST_VALUE_SIZE, 'v')});
+    appendFrame(batch, {"get", "k" + std::to_string(i % TEST_HOT_KEYS)});
+  }
+  ASSERT_EQ(socket.writeAll(fd, batch, batch.size()), 0);
+  for (std::size_t i = 0; i < 2 * TEST_KEYS; ++i) {
+    ASSERT_GT(readFrame(socket, fd).size(), 0);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200)); // idle evicts
+
+  auto live = keys();
+  ASSERT_GT(live.size(), 0);
+  ASSERT_LT(live.size(), TEST_KEYS);
+  stopServer();
+
+  startServer();
+  EXPECT_EQ(keys(), live);
+}
+
+/**
+ * @test Replays an INCR that ran before its key expired, after the deadline
+ * passed, and one that ran after and made the key anew.
+ */
+TEST_F(AofReplayTest, ReplayExpiresKeysAfterTheCommandsThatSawThem) {
+  startServer();
+  Socket socket;
+  socket.setOptions();
+  socket.configureConnection(port, TEST_CLIENT_NETADDR, "client");
+  auto fd = socket.getFd();
+  auto send = [&](const std::vector<CommandList> &commands) {
+    std::string batch;
+    for (const auto &command : commands) {
+      appendFrame(batch, command);
+    }
+    ASSERT_EQ(socket.writeAll(fd, batch, batch.size()), 0);
+    for (std::size_t i = 0; i < commands.size(); ++i) {
+      ASSERT_GT(readFrame(socket, fd).size(), 0);
+    }
+  };
+
+  send({{"set", "gone", "5"},
+        {"pexpire", "gone", "500"},
+        {"incr", "gone"}, // keeps the deadline
+        {"set", "again", "5"},
+        {"pexpire", "again", "100"}});
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  send({{"incr", "again"}}); // a new key, without a deadline
+  stopServer();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  startServer();
+  EXPECT_EQ(keys(), std::set<std::string>{"again"});
+}
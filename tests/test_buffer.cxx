@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <vector>
+
+#include "common/buffer.hxx"
+#include "common/serialize.hxx"
+
+constexpr std::size_t FIRST_CHUNK_SIZE = CHUNK_SIZES[0];
+
+class ChunkedBufferTest : public ::testing::Test {
+protected:
+  ChunkPool pool;
+  ChunkedBuffer buffer{pool};
+  std::vector<std::uint8_t> bytes =
+      std::vector<std::uint8_t>(3 * CHUNK_SIZES.back());
+
+  void SetUp() override { std::iota(bytes.begin(), bytes.end(), 0); }
+
+  auto usedChunks() -> std::size_t {
+    auto stats = pool.stats();
+    return std::accumulate(stats.used.begin(), stats.used.end(), 0UL);
+  }
+};
+
+TEST_F(ChunkedBufferTest, CopiesAcrossChunks) {
+  buffer.append(bytes.data(), bytes.size());
+  ASSERT_EQ(buffer.size(), bytes.size());
+  ASSERT_EQ(buffer.front().size(), FIRST_CHUNK_SIZE);
+
+  std::vector<std::uint8_t> out(CHUNK_SIZES.back());
+  buffer.copy(FIRST_CHUNK_SIZE / 2, out.data(), out.size());
+  EXPECT_TRUE(std::equal(out.begin(), out.end(),
+                         bytes.begin() + FIRST_CHUNK_SIZE / 2));
+}
+
+TEST_F(ChunkedBufferTest, ConsumeKeepsTheRestInPlace) {
+  buffer.append(bytes.data(), bytes.size());
+  const auto *last = buffer.front().data() + 10;
+  buffer.consume(10);
+  EXPECT_EQ(buffer.front().data(), last);
+
+  buffer.consume(FIRST_CHUNK_SIZE);
+  ASSERT_EQ(buffer.size(), bytes.size() - FIRST_CHUNK_SIZE - 10);
+  EXPECT_EQ(buffer.front()[0], bytes[FIRST_CHUNK_SIZE + 10]);
+
+  buffer.consume(buffer.size());
+  EXPECT_EQ(buffer.size(), 0);
+  EXPECT_TRUE(buffer.front().empty());
+}
+
+TEST_F(ChunkedBufferTest, GathersEveryChunk) {
+  buffer.append(bytes.data(), 10);
+  buffer.consume(5);
+  buffer.append(bytes.data(), FIRST_CHUNK_SIZE + CHUNK_SIZES[1]);
+
+  std::array<iovec, 8> iov;
+  auto count = buffer.gather(iov);
+  ASSERT_EQ(count, 3);
+
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    total += iov[i].iov_len;
+  }
+  EXPECT_EQ(total, buffer.size());
+  EXPECT_EQ(static_cast<std::uint8_t *>(iov[0].iov_base)[0], bytes[5]);
+}
+
+TEST_F(ChunkedBufferTest, DrainedBufferHoldsNoChunk) {
+  EXPECT_EQ(usedChunks(), 0);
+
+  buffer.append(bytes.data(), 100);
+  EXPECT_EQ(usedChunks(), 1);
+  EXPECT_EQ(pool.stats().used[0], 1);
+
+  buffer.consume(100);
+  EXPECT_EQ(usedChunks(), 0);
+  EXPECT_EQ(pool.stats().free[0], 1);
+
+  buffer.space();
+  buffer.shrink();
+  EXPECT_EQ(usedChunks(), 0);
+}
+
+TEST_F(ChunkedBufferTest, OutputBackpatchesAcrossChunks) {
+  buffer.append(bytes.data(), FIRST_CHUNK_SIZE - 2); // header straddles
+
+  Output output(buffer);
+  auto arr = out::begin_arr(output);
+  out::num(output, 42);
+  out::end_arr(output, arr, 1);
+  output.finish();
+
+  std::uint32_t len = 0;
+  buffer.copy(FIRST_CHUNK_SIZE - 2, &len, 4);
+  EXPECT_EQ(len, 1 + 4 + 1 + 8);
+  std::uint32_t n = 0;
+  buffer.copy(FIRST_CHUNK_SIZE - 2 + 4 + 1, &n, 4);
+  EXPECT_EQ(n, 1);
+}
+
+TEST_F(ChunkedBufferTest, OutputClearDropsOnlyTheResponse) {
+  buffer.append(bytes.data(), 10);
+
+  Output output(buffer);
+  out::str(output, std::string(CHUNK_SIZES[1], 'x'));
+  output.clear();
+  out::nil(output);
+  output.finish();
+
+  EXPECT_EQ(buffer.size(), 10 + 4 + 1);
+  EXPECT_EQ(usedChunks(), 1);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "common/evict.hxx"
+
+constexpr std::uint64_t START_MS = 1'000'000'000;
+constexpr std::size_t MANY_HITS = 100000;
+
+TEST(EvictTest, LruRanksTheLongestIdleFirst) {
+  auto early = evict::created(Eviction::LRU, START_MS);
+  auto late = evict::touched(early, Eviction::LRU, START_MS + 1000, 0);
+
+  auto now = START_MS + 5000;
+  ASSERT_GT(evict::rank(early, Eviction::LRU, now),
+            evict::rank(late, Eviction::LRU, now));
+  ASSERT_EQ(evict::rank(early, Eviction::LRU, now),
+            5000 / LRU_CLOCK_RESOLUTION);
+
+  // the clock wraps, the idle time does not
+  std::uint64_t wrap = (ACCESS_MASK + 1) * LRU_CLOCK_RESOLUTION;
+  auto wrapped = evict::created(Eviction::LRU, wrap - LRU_CLOCK_RESOLUTION);
+  ASSERT_EQ(evict::rank(wrapped, Eviction::LRU, wrap + LRU_CLOCK_RESOLUTION),
+            2);
+}
+
+TEST(EvictTest, LfuCountsLogarithmically) {
+  std::mt19937_64 rng(3);
+  auto access = evict::created(Eviction::LFU, START_MS);
+  ASSERT_EQ(evict::rank(access, Eviction::LFU, START_MS), LFU_MAX - LFU_INIT);
+
+  std::vector<std::uint32_t> counters;
+  for (std::size_t i = 1; i <= MANY_HITS; ++i) {
+    access = evict::touched(access, Eviction::LFU, START_MS, rng());
+    if (i == 100 || i == 1000 || i == MANY_HITS) {
+      auto rank = evict::rank(access, Eviction::LFU, START_MS);
+      counters.push_back(LFU_MAX - rank);
+    }
+  }
+
+  // about 10, 18 and 142 with a log factor of 10
+  ASSERT_GE(counters[0], 7);
+  ASSERT_LE(counters[0], 14);
+  ASSERT_GE(counters[1], 14);
+  ASSERT_LE(counters[1], 24);
+  ASSERT_GE(counters[2], 110);
+  ASSERT_LE(counters[2], 180);
+}
+
+TEST(EvictTest, LfuCountersDecay) {
+  std::mt19937_64 rng(5);
+  auto access = evict::created(Eviction::LFU, START_MS);
+  for (std::size_t i = 0; i < MANY_HITS; ++i) {
+    access = evict::touched(access, Eviction::LFU, START_MS, rng());
+  }
+  auto busy = evict::rank(access, Eviction::LFU, START_MS);
+
+  // one less for every period without a hit, down to nothing
+  auto later = START_MS + 3 * LFU_DECAY_MS;
+  ASSERT_EQ(evict::rank(access, Eviction::LFU, later), busy + 3);
+  ASSERT_EQ(evict::rank(access, Eviction::LFU, START_MS + 1000 * LFU_DECAY_MS),
+            LFU_MAX);
+
+  // a hit keeps the decayed count and restarts the period
+  access = evict::touched(access, Eviction::LFU, later, ~0ULL);
+  ASSERT_EQ(evict::rank(access, Eviction::LFU, later), busy + 3);
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/buffer.hxx"
+#include "common/req.hxx"
+#include "common/serialize.hxx"
+
+// runs one command, the reply without its length
+static auto run(Request &request, const std::vector<std::string> &commands)
+    -> std::string {
+  ChunkedBuffer buffer(ChunkPool::shared);
+  Arguments args;
+  for (const auto &s : commands) {
+    args.push_back(s);
+  }
+  Output output(buffer);
+  request(args, output);
+  output.finish();
+  std::string reply(buffer.size() - 4, '\0');
+  buffer.copy(4, reply.data(), reply.size());
+  return reply;
+}
+
+// the value of an integer reply at `at`
+static auto integer(const std::string &reply, std::size_t at = 0)
+    -> std::int64_t {
+  EXPECT_EQ(reply[at], 4);
+  std::int64_t value = 0;
+  std::memcpy(&value, reply.data() + at + 1, 8);
+  return value;
+}
+
+static auto expiredKeys(Request &request) -> std::int64_t {
+  auto stats = run(request, {"stats"});
+  std::string name = "expired_keys";
+  auto at = stats.find(name);
+  EXPECT_NE(at, std::string::npos);
+  return integer(stats, at + name.size());
+}
+
+TEST(ExpireTest, DeletingAKeyPastItsDeadlineCountsAnExpiry) {
+  Request request;
+  for (const auto *key : {"a", "b", "c"}) {
+    run(request, {"set", key, "value"});
+    run(request, {"pexpire", key, "1"});
+  }
+  run(request, {"set", "d", "value"});
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  // gone before the deletes reach them, like a lookup finds them
+  auto before = expiredKeys(request);
+  EXPECT_EQ(integer(run(request, {"del", "a"})), 0);
+  EXPECT_EQ(integer(run(request, {"mdel", "b", "c", "d"})), 1);
+  EXPECT_EQ(expiredKeys(request), before + 3);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "common/heap.hxx"
+
+constexpr std::size_t MANY_ITEMS = 10000;
+
+struct Item {
+  std::uint64_t deadline = 0;
+  std::uint32_t index = 0;
+};
+
+using ItemHeap = DeadlineHeap<Item, &Item::index>;
+
+TEST(DeadlineHeapTest, PopsInDeadlineOrder) {
+  ItemHeap heap;
+  std::vector<Item> items(MANY_ITEMS);
+  std::mt19937_64 rng(7);
+  for (auto &item : items) {
+    item.deadline = rng() % 1000; // plenty of equal deadlines
+    heap.set(&item, item.deadline);
+  }
+  ASSERT_EQ(heap.size(), items.size());
+
+  std::uint64_t last = 0;
+  while (!heap.empty()) {
+    auto *item = heap.top();
+    ASSERT_EQ(heap.topDeadline(), item->deadline);
+    ASSERT_GE(item->deadline, last);
+    last = item->deadline;
+    heap.remove(item);
+    ASSERT_EQ(item->index, 0);
+  }
+}
+
+TEST(DeadlineHeapTest, UpdatesAndRemovesAnyItem) {
+  ItemHeap heap;
+  std::vector<Item> items(MANY_ITEMS);
+  std::mt19937_64 rng(42);
+  for (auto &item : items) {
+    item.deadline = rng();
+    heap.set(&item, item.deadline);
+  }
+
+  // move half of the deadlines both ways, drop a quarter from the middle
+  for (std::size_t i = 0; i < items.size(); i += 2) {
+    items[i].deadline = rng();
+    heap.set(&items[i], items[i].deadline);
+  }
+  for (std::size_t i = 1; i < items.size(); i += 4) {
+    heap.remove(&items[i]);
+    heap.remove(&items[i]); // not stored anymore, nothing to do
+  }
+
+  std::vector<std::uint64_t> expected;
+  for (const auto &item : items) {
+    if (item.index) {
+      ASSERT_EQ(heap.deadline(&item), item.deadline);
+      expected.push_back(item.deadline);
+    }
+  }
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(heap.size(), expected.size());
+
+  for (auto deadline : expected) {
+    ASSERT_EQ(heap.topDeadline(), deadline);
+    heap.remove(heap.top());
+  }
+  ASSERT_TRUE(heap.empty());
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "common/lazyfree.hxx"
+#include "common/slab.hxx"
+
+constexpr std::size_t MANY_MEMBERS = 100000;
+
+static auto liveNodes() -> std::size_t {
+  return slab::stats().live[slab::sizeClass(sizeof(ZNode))];
+}
+
+static auto bigZSet() -> Entry * {
+  auto *entry = Entry::create("big");
+  entry->setZSet();
+  for (std::size_t i = 0; i < MANY_MEMBERS; ++i) {
+    auto name = std::to_string(i);
+    zset::add(entry->zset(), name, name.size(), static_cast<double>(i));
+  }
+  return entry;
+}
+
+TEST(LazyFreeTest, FreesLargeValuesInTheBackground) {
+  auto before = liveNodes();
+  auto freed = lazyfree::stats().freed;
+  auto *entry = bigZSet();
+  ASSERT_EQ(liveNodes(), before + MANY_MEMBERS);
+
+  lazyfree::destroy(entry);
+  lazyfree::drain();
+  ASSERT_EQ(lazyfree::stats().pending, 0);
+  ASSERT_EQ(lazyfree::stats().freed, freed + 1);
+  ASSERT_EQ(liveNodes(), before);
+}
+
+TEST(LazyFreeTest, FreesSmallValuesInPlace) {
+  auto freed = lazyfree::stats().freed;
+  auto *entry = Entry::create("small");
+  entry->setZSet();
+  zset::add(entry->zset(), "n1", 2, 1);
+
+  lazyfree::destroy(entry);
+  ASSERT_EQ(lazyfree::stats().pending, 0);
+  ASSERT_EQ(lazyfree::stats().freed, freed);
+}
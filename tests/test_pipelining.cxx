@@ -0,0 +1,174 @@
+#include <sys/wait.h>
+
+#include "common.hxx"
+
+constexpr std::int64_t TEST_PORT = 23456;
+constexpr std::size_t TEST_PIPELINE_DEPTH = 200;
+constexpr std::size_t TEST_LARGE_VALUE_SIZE = 1 << 20;
+
+/**
+ * @brief Appends one request frame to @p buffer.
+ *
+ * +-----+------+-----+------+-----+------+-----
+ * | len | nstr | len | str1 | len | str2 | ...
+ * +-----+------+-----+------+-----+------+-----
+ *
+ * @param buffer The buffer the frame is appended to.
+ * @param commands The command to frame.
+ */
+static void appendFrame(std::string &buffer, const CommandList &commands) {
+  std::uint32_t messageLength = 4;
+  for (const auto &s : commands) {
+    messageLength += 4 + s.size();
+  }
+  auto n = static_cast<std::uint32_t>(commands.size());
+  buffer.append(reinterpret_cast<char *>(&messageLength), 4);
+  buffer.append(reinterpret_cast<char *>(&n), 4);
+  for (const auto &s : commands) {
+    auto len = static_cast<std::uint32_t>(s.size());
+    buffer.append(reinterpret_cast<char *>(&len), 4);
+    buffer.append(s);
+  }
+}
+
+/**
+ * @brief Reads one response frame from @p fd.
+ *
+ * @param socket The socket used for the blocking read.
+ * @param fd The file descriptor to read from.
+ * @return the serialized response, or an empty string on error.
+ */
+static auto readFrame(const Socket &socket, std::int64_t fd) -> std::string {
+  std::string header(4, '\0');
+  if (socket.readFull(fd, header, 4)) {
+    return "";
+  }
+  std::uint32_t len = 0;
+  std::memcpy(&len, header.data(), 4);
+
+  std::string body(len, '\0');
+  if (socket.readFull(fd, body, len)) {
+    return "";
+  }
+  return body;
+}
+
+/**
+ * @class PipeliningTest
+ * @brief Test fixture for clients that pipeline many requests in one write.
+ *
+ * The server runs in a separate process with the backend given as the test
+ * parameter. The client writes a whole batch of frames at once, so the server
+ * receives several requests per read and has to answer all of them in order.
+ *
+ * Every test gets its own port, an io_uring instance may keep the listener of
+ * the previous server open for a moment after that server exits.
+ */
+class PipeliningTest : public ::testing::TestWithParam<Backend> {
+protected:
+  Socket clientSocket;
+  pid_t serverPid;
+  std::int64_t port;
+
+  void SetUp() override {
+    static std::int64_t nextPort = TEST_PORT;
+    port = nextPort++;
+    serverPid = fork();
+    if (serverPid == 0) {
+      try {
+        Config config;
+        config.backend = GetParam();
+        Server server(config);
+        server.run(port);
+      } catch (const std::exception &e) {
+        std::cerr << e.what() << '\n';
+        exit(1);
+      }
+      exit(0);
+    } else if (serverPid > 0) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    } else {
+      std::cerr << "Failed to fork server process" << '\n';
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    if (serverPid > 0) {
+      kill(serverPid, SIGTERM);
+      waitpid(serverPid, nullptr, 0);
+    }
+  }
+};
+
+INSTANTIATE_TEST_SUITE_P(Backends, PipeliningTest,
+                         ::testing::Values(Backend::EPOLL, Backend::URING));
+
+/**
+ * @test Sends a batch of interleaved SET and GET frames in a single write and
+ * checks that every response comes back, in order.
+ */
+TEST_P(PipeliningTest, AnswersEveryPipelinedRequest) {
+  clientSocket.setOptions();
+  clientSocket.configureConnection(port, TEST_CLIENT_NETADDR, "client");
+  auto fd = clientSocket.getFd();
+
+  std::string batch;
+  for (std::size_t i = 0; i < TEST_PIPELINE_DEPTH; ++i) {
+    appendFrame(batch, {"set", "k" + std::to_string(i), std::to_string(i)});
+    appendFrame(batch, {"get", "k" + std::to_string(i)});
+  }
+  ASSERT_EQ(clientSocket.writeAll(fd, batch, batch.size()), 0);
+
+  for (std::size_t i = 0; i < TEST_PIPELINE_DEPTH; ++i) {
+    auto set = readFrame(clientSocket, fd);
+    ASSERT_EQ(set.size(), 1);
+    EXPECT_EQ(set[0], std::to_underlying(Serialize::NIL));
+
+    auto get = readFrame(clientSocket, fd);
+    auto value = std::to_string(i);
+    ASSERT_EQ(get.size(), 1 + 4 + value.size());
+    EXPECT_EQ(get[0], std::to_underlying(Serialize::STR));
+    EXPECT_EQ(get.substr(1 + 4), value);
+  }
+}
+
+/**
+ * @test Stores and reads back a value that spans many buffer chunks, and lists
+ * enough keys that the KEYS response does too.
+ */
+TEST_P(PipeliningTest, AnswersRequestsLargerThanAChunk) {
+  clientSocket.setOptions();
+  clientSocket.configureConnection(port, TEST_CLIENT_NETADDR, "client");
+  auto fd = clientSocket.getFd();
+
+  std::string value(TEST_LARGE_VALUE_SIZE, 'v');
+  std::string batch;
+  appendFrame(batch, {"set", "large", value});
+  appendFrame(batch, {"get", "large"});
+  for (std::size_t i = 0; i < TEST_PIPELINE_DEPTH; ++i) {
+    appendFrame(batch, {"set", std::string(100, 'k') + std::to_string(i), ""});
+  }
+  appendFrame(batch, {"keys"});
+  ASSERT_EQ(clientSocket.writeAll(fd, batch, batch.size()), 0);
+
+  auto set = readFrame(clientSocket, fd);
+  ASSERT_EQ(set.size(), 1);
+  EXPECT_EQ(set[0], std::to_underlying(Serialize::NIL));
+
+  auto get = readFrame(clientSocket, fd);
+  ASSERT_EQ(get.size(), 1 + 4 + value.size());
+  EXPECT_EQ(get[0], std::to_underlying(Serialize::STR));
+  EXPECT_TRUE(get.substr(1 + 4) == value);
+
+  for (std::size_t i = 0; i < TEST_PIPELINE_DEPTH; ++i) {
+    ASSERT_EQ(readFrame(clientSocket, fd).size(), 1);
+  }
+
+  auto keys = readFrame(clientSocket, fd);
+  ASSERT_GT(keys.size(), TEST_PIPELINE_DEPTH * 100);
+  EXPECT_EQ(keys[0], std::to_underlying(Serialize::ARR));
+  std::uint32_t n = 0;
+  std::memcpy(&n, keys.data() + 1, 4);
+  EXPECT_EQ(n, TEST_PIPELINE_DEPTH + 1);
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "common/slab.hxx"
+
+constexpr std::size_t OBJECT_SIZE = 48;
+constexpr std::size_t MANY_OBJECTS = 10000;
+
+static auto live(std::size_t size) -> std::size_t {
+  return slab::stats().live[slab::sizeClass(size)];
+}
+
+TEST(SlabTest, ReusesFreedObjects) {
+  auto *first = slab::allocate(OBJECT_SIZE);
+  slab::deallocate(first, OBJECT_SIZE);
+  auto *second = slab::allocate(OBJECT_SIZE);
+  ASSERT_EQ(first, second); // straight off the thread cache
+  slab::deallocate(second, OBJECT_SIZE);
+}
+
+TEST(SlabTest, ObjectsAreAlignedAndDistinct) {
+  std::vector<void *> objects;
+  for (std::size_t i = 0; i < MANY_OBJECTS; ++i) {
+    auto *object = slab::allocate(OBJECT_SIZE - 3);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(object) % SLAB_ALIGNMENT, 0);
+    std::memset(object, static_cast<int>(i), OBJECT_SIZE - 3);
+    objects.push_back(object);
+  }
+  std::sort(objects.begin(), objects.end());
+  for (std::size_t i = 1; i < objects.size(); ++i) {
+    ASSERT_GE(static_cast<char *>(objects[i]) -
+                  static_cast<char *>(objects[i - 1]),
+              OBJECT_SIZE);
+  }
+  for (auto *object : objects) {
+    slab::deallocate(object, OBJECT_SIZE - 3);
+  }
+}
+
+TEST(SlabTest, StatsCountLiveObjects) {
+  auto before = live(OBJECT_SIZE);
+  std::vector<void *> objects;
+  for (std::size_t i = 0; i < MANY_OBJECTS; ++i) {
+    objects.push_back(slab::allocate(OBJECT_SIZE));
+  }
+  ASSERT_EQ(live(OBJECT_SIZE), before + MANY_OBJECTS);
+
+  auto stats = slab::stats();
+  auto sizeClass = slab::sizeClass(OBJECT_SIZE);
+  ASSERT_EQ(stats.live[sizeClass] + stats.free[sizeClass],
+            stats.pages[sizeClass] * (SLAB_PAGE_SIZE / OBJECT_SIZE));
+
+  for (auto *object : objects) {
+    slab::deallocate(object, OBJECT_SIZE);
+  }
+  ASSERT_EQ(live(OBJECT_SIZE), before);
+}
+
+TEST(SlabTest, LargeObjectsBypassTheSlabs) {
+  auto before = slab::stats();
+  auto *object = slab::allocate(SLAB_MAX_SIZE + 1);
+  ASSERT_EQ(slab::stats().pages, before.pages);
+  ASSERT_EQ(slab::stats().live, before.live);
+  slab::deallocate(object, SLAB_MAX_SIZE + 1);
+}
+
+TEST(SlabTest, ObjectsMoveBetweenThreads) {
+  auto before = live(OBJECT_SIZE);
+  std::vector<void *> objects(MANY_OBJECTS);
+
+  // allocated on one thread and freed on another, whose cache is flushed
+  // back to the shared lists when it exits
+  std::thread([&objects] {
+    for (auto &object : objects) {
+      object = slab::allocate(OBJECT_SIZE);
+    }
+  }).join();
+  ASSERT_EQ(live(OBJECT_SIZE), before + MANY_OBJECTS);
+
+  std::thread([&objects] {
+    for (auto *object : objects) {
+      slab::deallocate(object, OBJECT_SIZE);
+    }
+  }).join();
+  ASSERT_EQ(live(OBJECT_SIZE), before);
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "common/snapshot.hxx"
+
+constexpr std::size_t MANY_MEMBERS = 1000; // past the packed form
+
+static auto snapshotPath() -> std::string {
+  return (std::filesystem::temp_directory_path() /
+          ("test_snapshot." + std::to_string(getpid())))
+      .string();
+}
+
+static auto loadAll(const std::string &path)
+    -> std::map<std::string, std::pair<Entry *, std::int64_t>> {
+  std::map<std::string, std::pair<Entry *, std::int64_t>> keys;
+  snapshot::load(
+      path, [](std::uint64_t) {},
+      [&](Entry *entry, std::int64_t expireAt) {
+        keys[std::string(entry->key())] = {entry, expireAt};
+      });
+  return keys;
+}
+
+TEST(SnapshotTest, KeepsEveryValueAndExpiry) {
+  std::vector<Entry *> entries = {Entry::create("str"), Entry::create("int"),
+                                  Entry::create("small"), Entry::create("big")};
+  entries[0]->setString("a value too long to be stored inline");
+  entries[1]->setInteger(-42);
+  entries[2]->setZSet();
+  zset::add(entries[2]->zset(), "b", 1, 2);
+  zset::add(entries[2]->zset(), "a", 1, 2);
+  entries[3]->setZSet();
+  for (std::size_t i = 0; i < MANY_MEMBERS; ++i) {
+    auto name = std::to_string(i);
+    zset::add(entries[3]->zset(), name, name.size(), -static_cast<double>(i));
+  }
+
+  auto path = snapshotPath();
+  ASSERT_TRUE(snapshot::save(path, entries.size(), [&](SnapshotWriter &w) {
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      w.add(*entries[i], static_cast<std::int64_t>(i) * 1000);
+    }
+  }));
+  auto keys = loadAll(path);
+  std::remove(path.c_str());
+  ASSERT_EQ(keys.size(), entries.size());
+
+  std::array<char, MAX_INT_DIGITS> scratch{};
+  EXPECT_EQ(keys["str"].first->string(scratch), entries[0]->string(scratch));
+  EXPECT_EQ(keys["str"].second, 0);
+  std::int64_t num = 0;
+  ASSERT_TRUE(keys["int"].first->integer(num));
+  EXPECT_EQ(num, -42);
+  EXPECT_EQ(keys["int"].second, 1000);
+
+  for (std::size_t i = 2; i < entries.size(); ++i) {
+    const auto *saved = entries[i]->zset();
+    const auto *loaded = keys[std::string(entries[i]->key())].first->zset();
+    ASSERT_EQ(zset::size(loaded), zset::size(saved));
+    auto a = zset::query(saved, -INFINITY, "", 0);
+    auto b = zset::query(loaded, -INFINITY, "", 0);
+    for (; a && b; a = zset::offset(a, +1), b = zset::offset(b, +1)) {
+      EXPECT_EQ(zset::member(a).name, zset::member(b).name);
+      EXPECT_EQ(zset::member(a).score, zset::member(b).score);
+    }
+    EXPECT_FALSE(a || b);
+  }
+
+  for (auto *entry : entries) {
+    Entry::destroy(entry);
+  }
+  for (auto &[key, loaded] : keys) {
+    Entry::destroy(loaded.first);
+  }
+}
+
+TEST(SnapshotTest, RejectsATruncatedFile) {
+  auto *entry = Entry::create("key");
+  entry->setString("value");
+  auto path = snapshotPath();
+  ASSERT_TRUE(snapshot::save(path, 1, [&](SnapshotWriter &w) {
+    w.add(*entry, 0);
+  }));
+  Entry::destroy(entry);
+
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  std::vector<Entry *> loaded;
+  auto keep = [&](Entry *e, std::int64_t) { loaded.push_back(e); };
+  EXPECT_THROW(snapshot::load(path, [](std::uint64_t) {}, keep),
+               std::runtime_error);
+  std::remove(path.c_str());
+  for (auto *e : loaded) {
+    Entry::destroy(e);
+  }
+}
+
+TEST(SnapshotTest, RejectsAKeyCountTheFileCanNotHold) {
+  auto *entry = Entry::create("key");
+  entry->setString("value");
+  auto path = snapshotPath();
+  ASSERT_TRUE(snapshot::save(path, 1, [&](SnapshotWriter &w) {
+    w.add(*entry, 0);
+  }));
+  Entry::destroy(entry);
+
+  // the count after the magic and the version
+  int fd = ::open(path.c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  std::uint64_t keys = 1ULL << 40;
+  auto at = static_cast<off_t>(SNAPSHOT_MAGIC.size() + 4);
+  ASSERT_EQ(::pwrite(fd, &keys, sizeof(keys), at), sizeof(keys));
+  ::close(fd);
+
+  bool reserved = false;
+  EXPECT_THROW(snapshot::load(
+                   path, [&](std::uint64_t) { reserved = true; },
+                   [](Entry *e, std::int64_t) { Entry::destroy(e); }),
+               std::runtime_error);
+  EXPECT_FALSE(reserved); // nothing was sized for it
+  std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, BuildsSortedSetsInBatches) {
+  // more members than one hand over to the threads
+  constexpr std::size_t SETS = SNAPSHOT_BATCH_MEMBERS / 2;
+  std::vector<Entry *> entries;
+  for (std::size_t i = 0; i < SETS; ++i) {
+    auto *entry = entries.emplace_back(Entry::create("z" + std::to_string(i)));
+    entry->setZSet();
+    for (std::size_t j = 0; j < 3; ++j) {
+      auto name = "m" + std::to_string(j);
+      zset::add(entry->zset(), name, name.size(), static_cast<double>(i + j));
+    }
+  }
+  auto path = snapshotPath();
+  ASSERT_TRUE(snapshot::save(path, entries.size(), [&](SnapshotWriter &w) {
+    for (auto *entry : entries) {
+      w.add(*entry, 0);
+    }
+  }));
+  for (auto *entry : entries) {
+    Entry::destroy(entry);
+  }
+
+  std::uint64_t reserved = 0;
+  std::vector<Entry *> loaded;
+  snapshot::load(
+      path, [&](std::uint64_t keys) { reserved = keys; },
+      [&](Entry *entry, std::int64_t) { loaded.push_back(entry); });
+  EXPECT_EQ(reserved, SETS);
+  ASSERT_EQ(loaded.size(), SETS);
+  for (auto *entry : loaded) {
+    auto i = std::stoul(std::string(entry->key().substr(1)));
+    double score = -1;
+    ASSERT_TRUE(zset::lookup(entry->zset(), "m2", 2, score));
+    EXPECT_EQ(score, static_cast<double>(i + 2));
+    EXPECT_EQ(zset::size(entry->zset()), 3);
+    Entry::destroy(entry);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, RejectsUnsortedMembers) {
+  auto *entry = Entry::create("z");
+  entry->setZSet();
+  zset::add(entry->zset(), "a", 1, 1);
+  zset::add(entry->zset(), "b", 1, 2);
+  auto path = snapshotPath();
+  ASSERT_TRUE(snapshot::save(path, 1, [&](SnapshotWriter &w) {
+    w.add(*entry, 0);
+  }));
+  Entry::destroy(entry);
+
+  // the score of "b" goes below the one of "a"
+  double low = 0;
+  auto at = std::filesystem::file_size(path) - 1 - (8 + 4 + 1);
+  int fd = ::open(path.c_str(), O_WRONLY);
+  ASSERT_EQ(::pwrite(fd, &low, sizeof(low), static_cast<off_t>(at)),
+            sizeof(low));
+  ::close(fd);
+
+  EXPECT_THROW(snapshot::load(
+                   path, [](std::uint64_t) {},
+                   [](Entry *entry, std::int64_t) { Entry::destroy(entry); }),
+               std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(SnapshotTest, MissingFileIsEmpty) {
+  EXPECT_EQ(snapshot::load(
+                snapshotPath() + ".missing", [](std::uint64_t) { FAIL(); },
+                [](Entry *, std::int64_t) { FAIL(); }),
+            0);
+}
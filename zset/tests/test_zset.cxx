@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include <iterator>
+#include <map>
+#include <random>
+#include <set>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zset/zset.hxx"
+
+using Model = std::set<std::pair<double, std::string>>;
+
+class ZSetTest : public ::testing::Test {
+protected:
+  void TearDown() override {
+    zset::dispose(&set);
+    zset::limitPack(ZSET_PACK_MEMBERS, ZSET_PACK_NAME);
+  }
+
+  auto add(const std::string &name, double score) -> bool {
+    return zset::add(&set, name, name.size(), score);
+  }
+
+  // every member from (score, name) on, `off` members away, as zquery walks
+  auto range(double score, const std::string &name, std::int64_t off)
+      -> std::vector<std::pair<double, std::string>> {
+    std::vector<std::pair<double, std::string>> members;
+    auto cursor = zset::query(&set, score, name, name.size());
+    for (cursor = zset::offset(cursor, off); cursor;
+         cursor = zset::offset(cursor, +1)) {
+      auto member = zset::member(cursor);
+      members.emplace_back(member.score, std::string(member.name));
+    }
+    return members;
+  }
+
+  ZSet set{};
+};
+
+TEST_F(ZSetTest, PacksSmallSets) {
+  EXPECT_TRUE(add("b", 2));
+  EXPECT_TRUE(add("a", 1));
+  EXPECT_TRUE(add("c", 1));
+  EXPECT_FALSE(add("b", 0)); // moves to the front
+  ASSERT_NE(set.pack, nullptr);
+  ASSERT_EQ(set.tree, nullptr);
+  EXPECT_EQ(zset::size(&set), 3);
+
+  double score = -1;
+  ASSERT_TRUE(zset::lookup(&set, "b", 1, score));
+  EXPECT_EQ(score, 0);
+  EXPECT_FALSE(zset::lookup(&set, "d", 1, score));
+
+  Model expected = {{0, "b"}, {1, "a"}, {1, "c"}};
+  auto members = range(0, "", 0);
+  EXPECT_EQ(Model(members.begin(), members.end()), expected);
+
+  EXPECT_TRUE(zset::remove(&set, "a", 1));
+  EXPECT_FALSE(zset::remove(&set, "a", 1));
+  EXPECT_EQ(zset::size(&set), 2);
+  EXPECT_EQ(range(1, "", -1),
+            (std::vector<std::pair<double, std::string>>{{0, "b"}, {1, "c"}}));
+}
+
+TEST_F(ZSetTest, MovesToATreePastTheLimits) {
+  zset::limitPack(4, 8);
+  for (int i = 0; i < 4; ++i) {
+    add("m" + std::to_string(i), i);
+  }
+  ASSERT_NE(set.pack, nullptr);
+  add("m4", 4);
+  ASSERT_EQ(set.pack, nullptr);
+  ASSERT_NE(set.tree, nullptr);
+
+  double score = -1;
+  for (int i = 0; i < 5; ++i) {
+    auto name = "m" + std::to_string(i);
+    ASSERT_TRUE(zset::lookup(&set, name, name.size(), score));
+    EXPECT_EQ(score, i);
+  }
+
+  zset::dispose(&set);
+  add("short", 1);
+  ASSERT_NE(set.pack, nullptr);
+  add("a name past the limit", 2);
+  ASSERT_NE(set.tree, nullptr);
+  EXPECT_EQ(zset::size(&set), 2);
+}
+
+TEST_F(ZSetTest, PackedAndTreeSetsAgree) {
+  // the same operations on a packed set and on a tree from the start
+  for (std::size_t members : {ZSET_PACK_MEMBERS, std::size_t{0}}) {
+    zset::limitPack(members, ZSET_PACK_NAME);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> pick(0, 63);
+    Model model;
+    std::map<std::string, double> scores;
+
+    for (int i = 0; i < 2000; ++i) {
+      auto name = "k" + std::to_string(pick(gen));
+      double score = pick(gen) % 8;
+      if (pick(gen) % 3 == 0) {
+        ASSERT_EQ(zset::remove(&set, name, name.size()), scores.contains(name));
+        if (scores.contains(name)) {
+          model.erase({scores[name], name});
+          scores.erase(name);
+        }
+      } else {
+        ASSERT_EQ(add(name, score), !scores.contains(name));
+        if (scores.contains(name)) {
+          model.erase({scores[name], name});
+        }
+        scores[name] = score;
+        model.emplace(score, name);
+      }
+      ASSERT_EQ(zset::size(&set), model.size());
+    }
+    EXPECT_EQ(set.tree != nullptr, members == 0);
+
+    for (double score = 0; score < 8; ++score) {
+      for (std::int64_t off : {-5, -1, 0, 1, 3, 100}) {
+        auto from = model.lower_bound({score, "k3"});
+        auto rank = std::distance(model.begin(), from) + off;
+        std::vector<std::pair<double, std::string>> expected;
+        if (from != model.end() && rank >= 0 &&
+            rank < static_cast<std::int64_t>(model.size())) {
+          expected.assign(std::next(model.begin(), rank), model.end());
+        }
+        ASSERT_EQ(range(score, "k3", off), expected)
+            << "score " << score << " off " << off;
+      }
+    }
+    zset::dispose(&set);
+  }
+}
+
+TEST_F(ZSetTest, PackedSetsAreSmall) {
+  for (std::string name : {"alice", "bob", "carol"}) {
+    add(name, 1);
+  }
+  auto packed = zset::memory(&set);
+
+  zset::dispose(&set);
+  zset::limitPack(0, ZSET_PACK_NAME);
+  for (std::string name : {"alice", "bob", "carol"}) {
+    add(name, 1);
+  }
+  EXPECT_LT(packed * 10, zset::memory(&set));
+}
+
+TEST_F(ZSetTest, BuildsFromSortedMembers) {
+  std::vector<std::string> names;
+  std::vector<ZMember> members;
+  for (int i = 0; i < 1000; ++i) {
+    names.push_back("m" + std::to_string(1000 + i)); // sorted as strings too
+  }
+  for (int i = 0; i < 1000; ++i) {
+    members.push_back({.name = names[i], .score = i / 10.0});
+  }
+
+  ASSERT_TRUE(zset::build(&set, std::span(members).first(3)));
+  ASSERT_NE(set.pack, nullptr);
+  EXPECT_EQ(range(0, "", 0).size(), 3);
+  EXPECT_TRUE(add("m999", 1)); // a built pack takes inserts like any other
+  EXPECT_EQ(range(0, "", 0).back().second, "m999");
+  zset::dispose(&set);
+
+  ASSERT_TRUE(zset::build(&set, members));
+  ASSERT_NE(set.tree, nullptr);
+  EXPECT_EQ(zset::size(&set), members.size());
+  for (std::size_t i = 0; i < members.size(); i += 97) {
+    double score = -1;
+    ASSERT_TRUE(zset::lookup(&set, names[i], names[i].size(), score));
+    EXPECT_EQ(score, members[i].score);
+    // the subtree counts are right, so ranks are too
+    auto cursor = zset::offset(zset::query(&set, 0, "", 0),
+                               static_cast<std::int64_t>(i));
+    EXPECT_EQ(zset::member(cursor).name, names[i]);
+  }
+  for (std::size_t i = 0; i < members.size(); i += 2) {
+    ASSERT_TRUE(zset::remove(&set, names[i], names[i].size()));
+  }
+  EXPECT_EQ(range(0, "", 0).size(), members.size() / 2);
+  zset::dispose(&set);
+
+  std::swap(members[10], members[11]);
+  EXPECT_FALSE(zset::build(&set, members));
+  EXPECT_EQ(zset::size(&set), 0);
+}
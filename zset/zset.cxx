@@ -1,153 +1,415 @@
 #include "zset.hxx"
+#include "common/slab.hxx"
+
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <span>
+#include <vector>
 
-auto mapCmp = [](Node *node, Node *key) {
-  auto *znode = containerOf(node, ZNode, map);
-  auto *nodeKey = containerOf(key, Key, node);
-  if (znode->len != nodeKey->len)
-    return false;
-  return 0 == std::memcmp(znode->name.data(), nodeKey->name.data(), znode->len);
+static std::size_t packMembers = ZSET_PACK_MEMBERS;
+static std::size_t packName = ZSET_PACK_NAME;
+
+/**
+ * @struct ZPack
+ * @brief The header of a packed set, its members follow it.
+ *
+ */
+struct ZPack {
+  std::uint32_t size;     // bytes of members
+  std::uint32_t capacity; // bytes of room for members
+  std::uint32_t count;    // members
 };
 
-auto stringHash(const std::string &data) -> std::uint64_t {
-  std::uint32_t hash = 0x811C9DC5;
-  for (const auto &letter : data) {
-    hash = (hash + letter) * 0x01000193;
+// a packed member is its score, one byte of name length, then the name
+constexpr std::uint32_t PACKED_SCORE = sizeof(std::double_t);
+constexpr std::uint32_t PACKED_HEADER = PACKED_SCORE + 1;
+constexpr std::uint32_t PACK_MIN_CAPACITY = 16;
+
+static auto less(std::double_t lscore, std::string_view lname,
+                 std::double_t score, std::string_view name) -> bool {
+  if (lscore != score) {
+    return lscore < score;
   }
-  return hash;
+  return lname < name;
 }
 
-static auto less(const AVLNode *lhs, std::double_t score, std::string_view name,
-                 std::size_t len) -> bool {
-  auto *zl = containerOf(lhs, ZNode, tree);
-  if (zl->score != score) {
-    return zl->score < score;
+static auto bytes(const ZPack *pack) -> char * {
+  return reinterpret_cast<char *>(const_cast<ZPack *>(pack) + 1);
+}
+
+// the member at byte offset `at`
+static auto packed(const ZPack *pack, std::uint32_t at) -> ZMember {
+  const char *p = bytes(pack) + at;
+  ZMember member;
+  std::memcpy(&member.score, p, PACKED_SCORE);
+  member.name = {p + PACKED_HEADER, static_cast<std::uint8_t>(p[PACKED_SCORE])};
+  return member;
+}
+
+static auto packedNext(const ZPack *pack, std::uint32_t at) -> std::uint32_t {
+  return at + PACKED_HEADER +
+         static_cast<std::uint8_t>(bytes(pack)[at + PACKED_SCORE]);
+}
+
+// the byte offset of `name`, or the end of the members if it is not there
+static auto packFind(const ZPack *pack, std::string_view name)
+    -> std::uint32_t {
+  std::uint32_t at = 0;
+  while (at < pack->size && packed(pack, at).name != name) {
+    at = packedNext(pack, at);
   }
+  return at;
+}
+
+// the first member that is not less than (score, name), and its rank
+static auto packSeek(const ZPack *pack, std::double_t score,
+                     std::string_view name, std::uint32_t &rank)
+    -> std::uint32_t {
+  std::uint32_t at = 0;
+  rank = 0;
+  while (at < pack->size) {
+    auto member = packed(pack, at);
+    if (!less(member.score, member.name, score, name)) {
+      break;
+    }
+    at = packedNext(pack, at);
+    rank++;
+  }
+  return at;
+}
 
-  std::int64_t returnValue =
-      std::memcmp(zl->name.data(), name.data(), std::min(zl->len, len));
-  if (returnValue != 0) {
-    return returnValue < 0;
+static void packInsert(ZSet *set, std::string_view name, std::double_t score) {
+  auto need = PACKED_HEADER + static_cast<std::uint32_t>(name.size());
+  auto *pack = set->pack;
+  if (!pack || pack->size + need > pack->capacity) {
+    std::uint32_t size = pack ? pack->size : 0;
+    std::uint32_t grown = pack ? pack->capacity + pack->capacity / 2 : 0;
+    std::uint32_t capacity = std::max({size + need, grown, PACK_MIN_CAPACITY});
+    pack = static_cast<ZPack *>(std::realloc(pack, sizeof(ZPack) + capacity));
+    if (!set->pack) {
+      pack->size = 0;
+      pack->count = 0;
+    }
+    pack->capacity = capacity;
+    set->pack = pack;
   }
 
-  return zl->len < len;
+  std::uint32_t rank = 0;
+  auto at = packSeek(pack, score, name, rank);
+  char *p = bytes(pack) + at;
+  std::memmove(p + need, p, pack->size - at);
+  std::memcpy(p, &score, PACKED_SCORE);
+  p[PACKED_SCORE] = static_cast<char>(name.size());
+  std::memcpy(p + PACKED_HEADER, name.data(), name.size());
+  pack->size += need;
+  pack->count++;
 }
 
-static auto less(const AVLNode *lhs, const AVLNode *rhs) -> bool {
+static void packErase(ZPack *pack, std::uint32_t at) {
+  auto next = packedNext(pack, at);
+  std::memmove(bytes(pack) + at, bytes(pack) + next, pack->size - next);
+  pack->size -= next - at;
+  pack->count--;
+}
 
+static auto less(const AVLNode *lhs, std::double_t score, std::string_view name)
+    -> bool {
+  auto *zl = containerOf(lhs, ZNode, tree);
+  return less(zl->score, {zl->name.data(), zl->len}, score, name);
+}
+
+static auto less(const AVLNode *lhs, const AVLNode *rhs) -> bool {
   const auto *zr = containerOf(rhs, ZNode, tree);
-  return less(lhs, zr->score, zr->name, zr->len);
+  return less(lhs, zr->score, {zr->name.data(), zr->len});
 }
 
-static void treeAdd(ZSet *set, ZNode *node) {
+static void treeAdd(ZTree *tree, ZNode *node) {
   AVLNode *curr = nullptr;
-  AVLNode **from = &set->tree;
+  AVLNode **from = &tree->root;
   while (*from) {
     curr = *from;
     from = less(&node->tree, curr) ? &curr->left : &curr->right;
   }
   *from = &node->tree; // attach the new node
   node->tree.parent = curr;
-  set->tree = avl::fix(&node->tree);
+  tree->root = avl::fix(&node->tree);
+}
+
+// the slab object of the node, and the name if it is too long for the string
+static auto nodeSize(const ZNode *node) -> std::size_t {
+  std::size_t size = slab::allocationSize(sizeof(ZNode));
+  if (node->name.capacity() > std::string().capacity()) {
+    size += node->name.capacity() + 1;
+  }
+  return size;
 }
 
-static auto create(const std::string &name, std::size_t len,
-                   std::double_t score) -> ZNode * {
-  auto node = new ZNode();
+// a new node in the map of the tree, not linked into the tree yet
+static auto place(ZTree *tree, std::string_view name, std::double_t score)
+    -> ZNode * {
+  auto *node = new (slab::allocate(sizeof(ZNode))) ZNode();
   init(&node->tree);
-  node->map.next = nullptr;
-  node->map.code = stringHash(name);
   node->score = score;
-  node->len = len;
+  node->len = name.size();
+  node->name = name;
 
-  if (node->name.size() < len) {
-    node->name.resize(len);
-  }
-
-  std::copy(name.begin(), name.begin() + len, node->name.begin());
+  tree->nodeBytes += nodeSize(node);
+  tree->map.insert(node);
   return node;
 }
 
-namespace zset {
+static void create(ZTree *tree, std::string_view name, std::double_t score) {
+  treeAdd(tree, place(tree, name, score));
+}
 
-auto lookup(ZSet *set, const std::string &name, std::size_t len) -> ZNode * {
-  if (!set->tree)
+// links sorted nodes into a balanced tree, the middle one at the root: the
+// halves differ by at most one node, so no rotation is needed
+static auto link(std::span<ZNode *const> nodes, AVLNode *parent)
+    -> AVLNode * {
+  if (nodes.empty()) {
     return nullptr;
+  }
+  auto mid = nodes.size() / 2;
+  auto *root = &nodes[mid]->tree;
+  root->parent = parent;
+  root->left = link(nodes.first(mid), root);
+  root->right = link(nodes.subspan(mid + 1), root);
+  update(root);
+  return root;
+}
 
-  Key key;
-  key.node.code = stringHash(name);
-  key.name = name;
-  key.len = len;
-  auto const *found = map::lookup(&set->map, &key.node, mapCmp);
-  return found ? containerOf(found, ZNode, map) : nullptr;
+static void del(ZNode *node) {
+  node->~ZNode();
+  slab::deallocate(node, sizeof(ZNode));
 }
 
-static void update(ZSet *set, ZNode *node, std::double_t score) {
+static void update(ZTree *tree, ZNode *node, std::double_t score) {
   if (node->score == score) {
     return;
   }
-  set->tree = avl::del(&node->tree);
+  tree->root = avl::del(&node->tree);
   node->score = score;
   init(&node->tree);
-  treeAdd(set, node);
+  treeAdd(tree, node);
+}
+
+// moves the members of a packed set to a tree, for good
+static void unpack(ZSet *set) {
+  auto *tree = new ZTree();
+  if (auto *pack = set->pack) {
+    std::vector<ZNode *> nodes;
+    nodes.reserve(pack->count);
+    tree->map.reserve(pack->count);
+    for (std::uint32_t at = 0; at < pack->size; at = packedNext(pack, at)) {
+      auto member = packed(pack, at);
+      nodes.push_back(place(tree, member.name, member.score));
+    }
+    tree->root = link(nodes, nullptr); // already in order
+    std::free(pack);
+  }
+  set->pack = nullptr;
+  set->tree = tree;
 }
 
-auto add(ZSet *set, const std::string &name, std::size_t len,
-         std::double_t score) -> bool {
-  auto *node = lookup(set, name, len);
-  if (node) { // update the score of an existing pair
-    update(set, node, score);
+namespace zset {
+
+void limitPack(std::size_t members, std::size_t nameLength) {
+  packMembers = members;
+  packName = std::min(nameLength, ZSET_PACK_NAME_LIMIT);
+}
+
+auto add(ZSet *set, std::string_view name, std::size_t len, std::double_t score)
+    -> bool {
+  name = name.substr(0, len);
+  if (!set->tree) {
+    if (auto *pack = set->pack) {
+      auto at = packFind(pack, name);
+      if (at < pack->size) { // update the score of an existing pair
+        if (packed(pack, at).score != score) {
+          packErase(pack, at);
+          packInsert(set, name, score); // fits where the old one was
+        }
+        return false;
+      }
+    }
+    if (size(set) < packMembers && name.size() <= packName) {
+      packInsert(set, name, score);
+      return true;
+    }
+    unpack(set);
+  }
+
+  auto *tree = set->tree;
+  if (auto *node = tree->map.find(name)) {
+    update(tree, node, score);
     return false;
-  } else {
-    node = create(name, len, score);
-    map::insert(&set->map, &node->map);
-    treeAdd(set, node);
-    return true;
   }
+  create(tree, name, score);
+  return true;
 }
 
-auto pop(ZSet *set, const std::string &name, std::size_t len) -> ZNode * {
-  if (!set->tree)
-    return nullptr;
+auto build(ZSet *set, std::span<const ZMember> members) -> bool {
+  std::uint32_t total = 0; // bytes packed
+  bool packs = members.size() <= packMembers;
+  for (std::size_t i = 0; i < members.size(); ++i) {
+    const auto &member = members[i];
+    if (i > 0 && !less(members[i - 1].score, members[i - 1].name,
+                       member.score, member.name)) {
+      return false;
+    }
+    packs = packs && member.name.size() <= packName;
+    total += PACKED_HEADER + static_cast<std::uint32_t>(member.name.size());
+  }
+  if (members.empty()) {
+    return true;
+  }
 
-  Key key;
-  key.node.code = stringHash(name);
-  key.name = name;
-  key.len = len;
+  if (packs) { // written in order, nothing to shift
+    auto capacity = std::max(total, PACK_MIN_CAPACITY);
+    auto *pack = static_cast<ZPack *>(std::malloc(sizeof(ZPack) + capacity));
+    pack->size = total;
+    pack->capacity = capacity;
+    pack->count = static_cast<std::uint32_t>(members.size());
+    char *p = bytes(pack);
+    for (const auto &member : members) {
+      std::memcpy(p, &member.score, PACKED_SCORE);
+      p[PACKED_SCORE] = static_cast<char>(member.name.size());
+      std::memcpy(p + PACKED_HEADER, member.name.data(), member.name.size());
+      p += PACKED_HEADER + member.name.size();
+    }
+    set->pack = pack;
+    return true;
+  }
 
-  const auto *found = map::pop(&set->map, &key.node, mapCmp);
-  if (!found) {
-    return nullptr;
+  auto *tree = new ZTree();
+  std::vector<ZNode *> nodes;
+  nodes.reserve(members.size());
+  tree->map.reserve(members.size());
+  for (const auto &member : members) {
+    nodes.push_back(place(tree, member.name, member.score));
   }
+  tree->root = link(nodes, nullptr);
+  set->tree = tree;
+  return true;
+}
 
-  auto *node = containerOf(found, ZNode, map);
-  set->tree = avl::del(&node->tree);
-  return node;
+auto lookup(const ZSet *set, std::string_view name, std::size_t len,
+            std::double_t &score) -> bool {
+  name = name.substr(0, len);
+  if (const auto *pack = set->pack) {
+    auto at = packFind(pack, name);
+    if (at < pack->size) {
+      score = packed(pack, at).score;
+      return true;
+    }
+  } else if (set->tree) {
+    if (const auto *node = set->tree->map.find(name)) {
+      score = node->score;
+      return true;
+    }
+  }
+  return false;
 }
 
-auto query(ZSet *set, std::double_t score, const std::string &name,
-           std::size_t len) -> ZNode * {
+auto remove(ZSet *set, std::string_view name, std::size_t len) -> bool {
+  name = name.substr(0, len);
+  if (auto *pack = set->pack) {
+    auto at = packFind(pack, name);
+    if (at < pack->size) {
+      packErase(pack, at);
+      return true;
+    }
+  } else if (auto *tree = set->tree) {
+    if (auto *node = tree->map.pop(name)) {
+      tree->root = avl::del(&node->tree);
+      tree->nodeBytes -= nodeSize(node);
+      del(node);
+      return true;
+    }
+  }
+  return false;
+}
+
+auto query(const ZSet *set, std::double_t score, std::string_view name,
+           std::size_t len) -> ZCursor {
+  name = name.substr(0, len);
+  if (const auto *pack = set->pack) {
+    ZCursor cursor{.set = set};
+    cursor.at = packSeek(pack, score, name, cursor.rank);
+    return cursor.rank < pack->count ? cursor : ZCursor{};
+  }
+
   const AVLNode *found = nullptr;
-  auto *curr = set->tree;
+  auto *curr = set->tree ? set->tree->root : nullptr;
   while (curr) {
-    if (less(curr, score, name, len)) {
+    if (less(curr, score, name)) {
       curr = curr->right;
     } else {
       found = curr; // candidate
       curr = curr->left;
     }
   }
-  return found ? containerOf(found, ZNode, tree) : nullptr;
+  return found ? ZCursor{.set = set, .node = containerOf(found, ZNode, tree)}
+               : ZCursor{};
+}
+
+auto offset(ZCursor cursor, std::int64_t off) -> ZCursor {
+  if (!cursor) {
+    return cursor;
+  }
+  if (cursor.node) {
+    const auto *node = avl::offset(&cursor.node->tree, off);
+    cursor.node = node ? containerOf(node, ZNode, tree) : nullptr;
+    return cursor.node ? cursor : ZCursor{};
+  }
+
+  const auto *pack = cursor.set->pack;
+  auto rank = static_cast<std::int64_t>(cursor.rank) + off;
+  if (rank < 0 || rank >= pack->count) {
+    return {};
+  }
+  if (off < 0) { // the members only link forward
+    cursor.at = 0;
+    off = rank;
+  }
+  for (; off > 0; --off) {
+    cursor.at = packedNext(pack, cursor.at);
+  }
+  cursor.rank = static_cast<std::uint32_t>(rank);
+  return cursor;
+}
+
+auto member(const ZCursor &cursor) -> ZMember {
+  if (cursor.node) {
+    return {{cursor.node->name.data(), cursor.node->len}, cursor.node->score};
+  }
+  return packed(cursor.set->pack, cursor.at);
 }
 
-auto offset(ZNode *node, std::int64_t off) -> ZNode * {
-  const auto *offsetNode = node ? avl::offset(&node->tree, off) : nullptr;
-  return offsetNode ? containerOf(offsetNode, ZNode, tree) : nullptr;
+auto size(const ZSet *set) -> std::size_t {
+  if (set->tree) {
+    return set->tree->map.size();
+  }
+  return set->pack ? set->pack->count : 0;
 }
 
-void del(ZNode *node) { free(node); }
+void dispose(ZSet *set) {
+  if (set->tree) {
+    set->tree->map.forEach([](ZNode &node) { del(&node); });
+    delete set->tree;
+  }
+  std::free(set->pack);
+  *set = {};
+}
 
-void dispose(ZSet *set) { map::destroy(&set->map); }
+auto memory(const ZSet *set) -> std::size_t {
+  if (set->tree) {
+    return sizeof(ZTree) + set->tree->nodeBytes + set->tree->map.memory();
+  }
+  return set->pack ? sizeof(ZPack) + set->pack->capacity : 0;
+}
 
 } // namespace zset
@@ -1,12 +1,17 @@
+#pragma once
+
 #include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 
 #include "avl/c/wrap.hxx"
-#include "map/c/wrap.hxx"
+#include "hash/hash.hxx"
+#include "map/cxx/intrusive.hxx"
 
 #define containerOf(ptr, type, member)                                         \
   ({                                                                           \
@@ -14,37 +19,124 @@
     (type *)((char *)__mptr - offsetof(type, member));                         \
   })
 
-struct ZSet {
-  AVLNode *tree = nullptr;
-  Map map;
-};
-
-struct Key {
-  Node node;
-  std::string name;
-  std::size_t len = 0;
-};
+// the defaults of --zset-max-pack-members and --zset-max-pack-name
+constexpr std::size_t ZSET_PACK_MEMBERS = 128;
+constexpr std::size_t ZSET_PACK_NAME = 64;
+constexpr std::size_t ZSET_PACK_NAME_LIMIT = 255; // the length is one byte
 
 struct ZNode {
   AVLNode tree;
-  Node map;
+  HashNode map;
   std::double_t score = 0;
   std::size_t len = 0;
   std::string name;
 };
 
-auto stringHash(const std::string &data) -> std::uint64_t;
+struct ZNodeHash {
+  auto operator()(const ZNode &node) const -> std::uint64_t {
+    return stringHash({node.name.data(), node.len});
+  }
+  auto operator()(std::string_view name) const -> std::uint64_t {
+    return stringHash(name);
+  }
+};
+
+struct ZNodeEq {
+  auto operator()(const ZNode &node, std::string_view name) const -> bool {
+    return std::string_view(node.name.data(), node.len) == name;
+  }
+};
+
+/**
+ * @struct ZTree
+ * @brief A large sorted set: an AVL tree by (score, name) for the ranges and
+ * a map by name for the lookups, over the same nodes.
+ *
+ */
+struct ZTree {
+  AVLNode *root = nullptr;
+  IntrusiveHashMap<ZNode, &ZNode::map, ZNodeHash, ZNodeEq> map;
+  std::size_t nodeBytes = 0; // the nodes and their names
+};
+
+struct ZPack;
+
+/**
+ * @struct ZSet
+ * @brief A sorted set, packed while it is small.
+ *
+ * A small set keeps its members in one buffer, sorted by (score, name), each
+ * a score, a length byte and the name. Lookups and inserts scan and shift it,
+ * which beats chasing nodes for a few dozen members. Once a set has more than
+ * --zset-max-pack-members members, or a name longer than
+ * --zset-max-pack-name bytes, it moves to a ZTree for good.
+ *
+ * A zero initialized ZSet is an empty set.
+ */
+struct ZSet {
+  ZPack *pack; /** The members of a small set, or nullptr */
+  ZTree *tree; /** The members of a large set, or nullptr */
+};
+
+/**
+ * @struct ZMember
+ * @brief A member of a sorted set, viewed in place.
+ *
+ */
+struct ZMember {
+  std::string_view name;
+  std::double_t score = 0;
+};
+
+/**
+ * @struct ZCursor
+ * @brief A position in a sorted set, valid until the set changes.
+ *
+ */
+struct ZCursor {
+  const ZSet *set = nullptr; /** nullptr past either end */
+  ZNode *node = nullptr;     /** The member, in a tree */
+  std::uint32_t rank = 0;    /** The member, in a pack */
+  std::uint32_t at = 0;      /** Its byte offset in the pack */
+
+  explicit operator bool() const { return set != nullptr; }
+};
 
 namespace zset {
 
-auto add(ZSet *set, const std::string &name, std::size_t len,
-         std::double_t score) -> bool;
-auto lookup(ZSet *set, const std::string &name, std::size_t len) -> ZNode *;
-auto pop(ZSet *set, const std::string &name, std::size_t len) -> ZNode *;
-auto query(ZSet *set, std::double_t score, const std::string &name,
-           std::size_t len) -> ZNode *;
-auto offset(ZNode *node, std::int64_t off) -> ZNode *;
-void del(ZNode *node);
+/**
+ * @brief Sets when a packed set moves to a tree.
+ *
+ * @param members The most members of a packed set.
+ * @param nameLength The longest name in a packed set, at most
+ * ZSET_PACK_NAME_LIMIT.
+ */
+void limitPack(std::size_t members, std::size_t nameLength);
+
+auto add(ZSet *set, std::string_view name, std::size_t len, std::double_t score)
+    -> bool;
+/**
+ * @brief Fills an empty set with @p members at once.
+ *
+ * The members come in (score, name) order with distinct names, the way a
+ * cursor walks a set. A set small enough to pack is copied into its buffer, a
+ * larger one gets a balanced tree linked bottom up, O(n) without a rotation.
+ *
+ * @param set An empty set.
+ * @param members The members, sorted.
+ * @return false, with the set still empty, if the members are out of order.
+ */
+auto build(ZSet *set, std::span<const ZMember> members) -> bool;
+
+auto lookup(const ZSet *set, std::string_view name, std::size_t len,
+            std::double_t &score) -> bool;
+auto remove(ZSet *set, std::string_view name, std::size_t len) -> bool;
+auto query(const ZSet *set, std::double_t score, std::string_view name,
+           std::size_t len) -> ZCursor;
+auto offset(ZCursor cursor, std::int64_t off) -> ZCursor;
+auto member(const ZCursor &cursor) -> ZMember;
+auto size(const ZSet *set) -> std::size_t;
 void dispose(ZSet *set);
+auto memory(const ZSet *set) -> std::size_t;
 
-} // namespace zset
\ No newline at end of file
+} // namespace zset